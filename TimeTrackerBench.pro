@@ -0,0 +1,45 @@
+######################################################################
+# Benchmarks on generated histories - see src/bench.cpp
+# Build with qmake TimeTrackerBench.pro && make, run ./TTTBench [results file] [--quick]
+######################################################################
+
+TEMPLATE = app
+TARGET = TTTBench
+INCLUDEPATH += . ./include
+
+QT += widgets
+
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+DEFINES += NDEBUG    # Time release code - skips the debug query plan checks
+CONFIG += release
+
+# Input
+SOURCES += src/bench.cpp
+
+HEADERS += include/dataObjects.h \
+           include/idGenerators.h \
+           include/project.h \
+           include/projectManager.h \
+           include/projectListIndex.h \
+           include/slotMap.h \
+           include/TrackerData.h \
+           include/dataInterface.h \
+           include/activationSchedule.h \
+           include/asyncDataIO.h \
+           include/readerPool.h \
+           include/calendarBuckets.h \
+           include/durationIndex.h \
+           include/flatfileStore.h \
+           include/memoryStore.h \
+           include/stampColumns.h \
+           include/syntheticHistory.h \
+           include/timeWrapper.h \
+           include/timestampProcessor.h
+
+# Separate from the app's, so both can be built in the same tree
+OBJECTS_DIR = ./obj_bench
+MOC_DIR = ./moc_bench
+
+QMAKE_CXXFLAGS_WARN_ON  = '-Wall'
+CONFIG += c++11
+LIBS = -lsqlite3
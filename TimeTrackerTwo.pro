@@ -30,8 +30,18 @@ HEADERS += include/Controller.h \
            include/project.h \
            include/projectbutton.h \
            include/projectManager.h \
+           include/projectListIndex.h \
+           include/slotMap.h \
            include/TrackerData.h \
            include/dataInterface.h \
+           include/activationSchedule.h \
+           include/asyncDataIO.h \
+           include/readerPool.h \
+           include/calendarBuckets.h \
+           include/durationIndex.h \
+           include/flatfileStore.h \
+           include/memoryStore.h \
+           include/stampColumns.h \
            include/timeWrapper.h \
            include/timestampProcessor.h \
            include/appClock.h
@@ -28,16 +28,13 @@ Q_OBJECT
 
     currentData->loadProjects(clock->now());
 
-      //TODO consolidate stamps into daily digests and store per entity - easier reporting and better long-term use
-      //TODO be careful of embedding 'day' too deeply - what if something runs past midnight? What about travelling to another time Zone? 
+      //TODO be careful of embedding 'day' too deeply - What about travelling to another time Zone? Digests are keyed on local midnight when written
 
       //TODO allow editing of projects
       //TODO - allow editing of inactive projects? For those that will start in the future? "Upcoming"
       //TODO ditto subprojects
 
       //TODO allow review of stamps
-
-      //TODO - emit signal every midnight to roll over start/end dates
   }
 
   void connectSignals(){
@@ -50,6 +47,7 @@ Q_OBJECT
 
     // Update the view when the project list changes
     connect(currentData, &TrackerData::projectListUpdateEvent, theView, &View::projectListUpdated);
+    connect(currentData, &TrackerData::projectListChangeEvent, theView, &View::projectListChanged);
     connect(currentData, &TrackerData::projectTotalUpdateEvent, theView, &View::projectTimeUpdated);
 
     // Connect the project selection to the TrackerData to mark projects
@@ -82,13 +80,20 @@ Q_OBJECT
     connect(currentData, &TrackerData::projectSummaryReady, theView, &View::summaryDisplayUpdated);
 
     //Adding project and sub
-    connect(theView, &View::projectAddRequested, currentData, &TrackerData::createProject);
+    connect(theView, &View::projectAddRequested, [this](const projectData & dat){currentData->createProject(dat, this->clock->now());});
     connect(theView, &View::subprojectAddRequested, currentData, &TrackerData::createSubproject);
     connect(theView, &View::projectOneOffAdd, currentData, &TrackerData::createOneOff);
 
     //Time summary view
     connect(theView, &View::timeSummaryRequested, currentData, &TrackerData::generateTimeSummary);
+    // Range summaries are read in the background. The range stops at app time now - nothing is tracked past it
+    connect(theView, &View::timeSummaryRangeRequested, [this](timeSummaryUnit unit, QDateTime start, QDateTime end){
+      timecode now = this->clock->now();
+      currentData->requestTimeSummaryBetween(unit, timeWrapper::toSeconds(fromQDateTime(start)), std::min(timeWrapper::toSeconds(fromQDateTime(end)), now));
+    });
+    connect(theView, &View::timeSummaryCancelled, currentData, &TrackerData::cancelTimeSummary);
     connect(currentData, &TrackerData::timeSummaryReady, theView, &View::timeSummaryUpdated);
+    connect(currentData, &TrackerData::timeSummaryProgress, theView, &View::timeSummaryProgress);
 
 
     //Clock ticking
@@ -96,21 +101,25 @@ Q_OBJECT
     clockTicker->start(1000);
     connect(clockTicker, &QTimer::timeout, [this](){this->clock->tick(); emit clockUpdated(this->clock->shortTimeString());});
     connect(this, &Controller::clockUpdated, theView, &View::updateClockDisplay);
+    // Group-commit batches only age out when something checks them
+    connect(clockTicker, &QTimer::timeout, currentData, &TrackerData::flushPendingWrites);
+    // Projects start and end as the clock passes their dates. Cheap when none is due
+    connect(clockTicker, &QTimer::timeout, [this](){currentData->updateProjectActivation(this->clock->now());});
 
     //Time travelling:
     //To show a dialog, view needs to know the time now:
     connect(theView, &View::fetchTimeTravelInfo, [this](){theView->showTimeTravelDialog(this->clock->shortTimeString(), QDateTime::currentDateTime());});
-    connect(theView, &View::timeTravelRequested, [this](QDateTime time){this->clock->travelTo(fromQDateTime(time));});
+    connect(theView, &View::timeTravelRequested, [this](QDateTime time){
+      this->clock->travelTo(fromQDateTime(time));
+      this->clock->tick();
+      currentData->updateProjectActivation(this->clock->now());
+      currentData->reportActiveAt(timeWrapper::toSeconds(fromQDateTime(time)));
+    });
 
   }
   TW_timePoint fromQDateTime(QDateTime time){
-    //Convert from QT time to app time, going via a string
-    // Format  "%Y-%m-%d %H:%M:%S"
-    std::string time_str;
-    time_str = time.toString("yyyy-MM-dd hh:mm:ss").toStdString();
-    //std::cout<<time_str<<std::endl;
-    //std::cout<<timeWrapper::formatTime(timeWrapper::parseTimeZoned(time_str))<<std::endl;
-    return timeWrapper::parseTimeZoned(time_str);
+    //Convert from QT time to app time, directly in seconds since the epoch
+    return timeWrapper::fromSeconds(time.toSecsSinceEpoch());
   }
 
   signals:
@@ -2,6 +2,10 @@
 #define ____trackerData__
 
 #include <QWidget>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <unordered_set>
 #include <vector>
 #include <sstream>
 
@@ -10,8 +14,11 @@
 
 #include "projectManager.h"
 #include "dataInterface.h"
+#include "asyncDataIO.h"
+#include "readerPool.h"
 #include "timeWrapper.h"
 #include "timestampProcessor.h"
+#include "durationIndex.h"
 
 namespace trackerTypes{
 
@@ -22,6 +29,56 @@ class projectStatus{
     std::string name;
     projectStatusFlag status = projectStatusFlag::none; /**< \brief Status of project */
 };
+
+/** \brief Copy of what a time summary needs from the projectManager, so one can be built away from it - e.g. on a worker thread */
+struct summarySnapshot{
+  struct sub{
+    std::string name;
+    proIds::Uuid uid;
+    float frac;
+  };
+  struct project{
+    std::string name;
+    proIds::Uuid uid;
+    float FTE;
+    std::vector<sub> subs; /**< \brief In display order */
+  };
+  std::vector<project> projects; /**< \brief In display order */
+  std::unordered_set<proIds::Uuid, proIds::uidHash> known; /**< \brief Every project and subproject - anything else tracked is a one-off */
+};
+
+/** \brief Everything in a time summary but the formatting - none of it depends on the display unit */
+struct summaryTotals{
+  std::map<proIds::Uuid, timecode> durations; /**< \brief Per entity, one-offs included */
+  timecode uptime = 0; /**< \brief Time tracked on anything */
+  timecode oneoffs = 0; /**< \brief Part of uptime on one-offs */
+  proIds::Uuid running = proIds::NullUid; /**< \brief For totals up to now, what is still accruing time */
+  timecode asOf = timecodeNull; /**< \brief Time the totals run to, where running is set */
+  summarySnapshot projects;
+
+  summaryTotals() = default;
+  summaryTotals(std::map<proIds::Uuid, timecode> durations_in, summarySnapshot projects_in) : durations(std::move(durations_in)), projects(std::move(projects_in)){
+    for(auto & item : durations){
+      if(item.first == proIds::NullUid) continue; // Paused or stopped
+      uptime += item.second;
+      if(projects.known.count(item.first) == 0) oneoffs += item.second;
+    }
+  }
+
+  timecode timeOn(const proIds::Uuid & uid) const{
+    auto it = durations.find(uid);
+    return it == durations.end() ? 0 : it->second;
+  }
+  /** \brief Carry totals up to now on to a later now, crediting whatever is still running */
+  void advanceTo(timecode now){
+    if(running == proIds::NullUid || now <= asOf) return;
+    timecode extra = now - asOf;
+    durations[running] += extra;
+    uptime += extra;
+    if(projects.known.count(running) == 0) oneoffs += extra;
+    asOf = now;
+  }
+};
 };
 
 class TrackerData: public QWidget{
@@ -30,35 +87,256 @@ Q_OBJECT
   projectManager thePM;
   trackerTypes::projectStatus currentProjectStatus; /**< \brief Current project status*/
   dataIO * dataHandler = nullptr; /**< \brief Data handler for reading/writing data */
+  asyncDataIO * asyncHandler = nullptr; /**< \brief Same object as dataHandler if writes are in the background, else null */
+  runningTotals totals; /**< \brief Per-entity time so far, kept in step with every stamp written */
+  durationIndex rangeIndex; /**< \brief For time within a date range. Built on first use, then kept in step */
+  bool rangeIndexBuilt = false;
+  readerPool * summaryWorkers = nullptr; /**< \brief For background summaries. Started on first use */
+  std::atomic<unsigned long long> summaryRequest{0}; /**< \brief Bumped by every summary request - a background one working for an older number has been superseded */
+  struct summarySuperseded{}; /**< \brief Thrown to abandon a superseded background summary */
+  unsigned long long dataGeneration = 0; /**< \brief Bumped by every stamp written and every project change */
+  struct cachedTotals{
+    trackerTypes::summaryTotals sum;
+    unsigned long long lastUse = 0; /**< \brief summaryCacheUses when last looked up or stored */
+  };
+  std::map<std::pair<timecode, timecode>, cachedTotals> summaryCache; /**< \brief Summary totals by range, all from data at summaryCacheGeneration. {timecodeNull, timecodeNull} is the whole history up to now */
+  unsigned long long summaryCacheGeneration = 0;
+  unsigned long long summaryCacheUses = 0;
+  static const size_t summaryCacheLimit = 16; /**< \brief Past this the least recently used range is dropped */
+
+  /** \brief Start a new summary request, superseding any before it. Returns its number */
+  unsigned long long supersedeSummaries(){
+    if(summaryWorkers) summaryWorkers->clearQueued();
+    return ++summaryRequest;
+  }
+
+  /** \brief Cached summary totals for a range, or null if there are none for the data as it is now */
+  trackerTypes::summaryTotals * cachedSummary(timecode start, timecode end){
+    if(summaryCacheGeneration != dataGeneration){
+      summaryCache.clear();
+      summaryCacheGeneration = dataGeneration;
+    }
+    auto it = summaryCache.find({start, end});
+    if(it == summaryCache.end()) return nullptr;
+    it->second.lastUse = ++summaryCacheUses;
+    return &it->second.sum;
+  }
+  /** \brief Keep summary totals built from the data at generation. Returns the cached copy, or null if the data has moved on since */
+  trackerTypes::summaryTotals * cacheSummary(timecode start, timecode end, unsigned long long generation, trackerTypes::summaryTotals sum){
+    if(generation != dataGeneration) return nullptr;
+    if(!cachedSummary(start, end) && summaryCache.size() >= summaryCacheLimit){ // Also clears out any older generation
+      auto oldest = std::min_element(summaryCache.begin(), summaryCache.end(), [](const auto & a, const auto & b){return a.second.lastUse < b.second.lastUse;});
+      summaryCache.erase(oldest);
+    }
+    auto & entry = summaryCache[{start, end}];
+    entry.sum = std::move(sum);
+    entry.lastUse = ++summaryCacheUses;
+    return &entry.sum;
+  }
+
+  /** \brief Load the running totals from the backend - closed intervals from the daily digests, plus the latest stamp */
+  void seedTotals(){
+    std::map<proIds::Uuid, timecode> closed;
+    for(auto & dg : dataHandler->fetchDailyDigests()) closed[dg.entityUid] += dg.duration;
+    try{
+      totals.seed(closed, dataHandler->fetchLatestTrackerEntry(), dataHandler->fetchEarliestTrackerEntry().time);
+    }catch(const std::runtime_error &e){
+      totals.clear(); // No timestamp entries yet
+    }
+  }
+  /** \brief Write a stamp and fold it into the running totals */
+  void recordStamp(const timeStamp & stamp){
+    if(!totals.empty() && stamp.time <= totals.latest().time){
+      // At or before the latest (time travel, or two in a second) - it splits an interval already in the totals. Every backend puts it after entries at the same time
+      auto runningThen = dataHandler->fetchTrackerEntryAt(stamp.time).projectUid;
+      dataHandler->writeTrackerEntry(stamp);
+      totals.insert(stamp, runningThen, dataHandler->fetchTrackerEntryAfter(stamp.time).time);
+    }else{
+      dataHandler->writeTrackerEntry(stamp);
+      totals.add(stamp);
+    }
+    dataGeneration++;
+    if(rangeIndexBuilt && !rangeIndex.add(stamp)) rangeIndexBuilt = false; // Out of order - rebuild when next needed
+  }
+  /** \brief Per-entity time within [start, end), from the range index */
+  std::map<proIds::Uuid, timecode> durationsBetween(timecode start, timecode end){
+    if(!rangeIndexBuilt){
+      rangeIndex.build(dataHandler->fetchTrackerEntries());
+      rangeIndexBuilt = true;
+    }
+    return rangeIndex.durationsBetween(start, end);
+  }
+
+  /**
+   * @brief Summary totals for [start, end), streamed from reader - for a worker's own connection, so no use of the range index or the manager
+   *
+   * Between chunks, checks request is still the latest, throwing summarySuperseded if not. progress is given the percentage of the range read so far, when it changes
+   */
+  trackerTypes::summaryTotals summariseRange(dataIO & reader, unsigned long long request, timecode start, timecode end, const trackerTypes::summarySnapshot & snap, const std::function<void(int)> & progress){
+    durationAccumulator acc(start, end, reader.fetchTrackerEntryAt(start).projectUid);
+    int reported = -1;
+    reader.streamTrackerEntries([&](const std::vector<timeStamp> & chunk){
+      if(summaryRequest.load() != request) throw summarySuperseded();
+      acc.add(chunk);
+      int percent = end > start ? (int)std::min<timecode>(100, 100 * (chunk.back().time - start) / (end - start)) : 100;
+      if(percent != reported) progress(reported = percent);
+    }, start, end);
+    if(summaryRequest.load() != request) throw summarySuperseded();
+    if(reported != 100) progress(100);
+    return {acc.result(), snap};
+  }
+
+  /** \brief What a time summary needs from the manager, copied out */
+  trackerTypes::summarySnapshot summaryProjects(){
+    trackerTypes::summarySnapshot snap;
+    for(auto & proj : thePM.getOrderedProjectRefs()){
+      trackerTypes::summarySnapshot::project item{proj->getName(), proj->getUid(), proj->getFTE(), {}};
+      for(auto & sub : thePM.getOrderedSubRefs(*proj)) item.subs.push_back({sub->getName(), sub->getUid(), sub->getFrac()});
+      snap.projects.push_back(std::move(item));
+    }
+    for(auto & uid : thePM.getKnownUids()) snap.known.insert(uid);
+    return snap;
+  }
+
+  /** \brief Summary lines for the given totals in the given unit, under a header line. Only formats, so cheap to redo for a change of unit */
+  static std::vector<timeSummaryItem> formatTimeSummary(timeSummaryUnit units, const trackerTypes::summaryTotals & sum, const std::string & header){
+    std::vector<timeSummaryItem> summary;
+    // A vector of items to be displayed in order - expect display to add newlines between items
+
+    //TODO - add an FTE/week and compare absolute
+
+    const float targetThresholdFTE = 0.01;
+    const float targetThresholdFractionFrac = 0.01; // Ditto for sub fracs
+
+    std::string unit_str = unitToString(units);
+    timecode unit_factor = unitToDivisor(units);
+
+    std::string tmp_str;
+    timeSummaryItem item = {header, timeSummaryStatus::none};
+    summary.push_back(item);
+
+    timecode uptime = sum.uptime, oneoffs = sum.oneoffs;
+
+    tmp_str = displayFloat(uptime/unit_factor, 1); //TODO rounding
+    item = {"Total uptime "+tmp_str+" "+unit_str, timeSummaryStatus::none};
+    summary.push_back(item);
+
+    // If there's no uptime, there's no point showing projects
+    if(uptime == 0){
+      summary.push_back({"Zero uptime - skipping project display", timeSummaryStatus::error});
+      return summary;
+    }
+
+    // NOTE: from here we know uptime is non-zero and rely on this below
+
+    //Allowing tracking under top-level, OR sub
+    // Project totals are for main and all subs
+    // Fractions apply to subs against total project time
+    // Fractions should add to at most 1
+
+    for(auto & proj : sum.projects.projects){
+      auto & subs = proj.subs;
+ 
+      item = {proj.name, timeSummaryStatus::none};
+      summary.push_back(item);
+
+      auto time = sum.timeOn(proj.uid); // Time on project itself
+      timecode subTimes = 0;
+      for(auto & sub : subs){
+        subTimes += sum.timeOn(sub.uid); //Sum on subs
+      }
+
+      item = {"Time on project and subs: "+ displayFloatQuarters((time + subTimes)/unit_factor) + " "+unit_str, timeSummaryStatus::none};
+      summary.push_back(item);
+
+      float frac = (float)(time+subTimes)/(float)uptime; //See above - uptime cannot be zero here
+      float FTE = proj.FTE;
+      timeSummaryStatus tag = timeSummaryStatus::onTarget;
+      if(frac - FTE > targetThresholdFTE){
+        tag = timeSummaryStatus::overTarget;
+      }else if(FTE - frac > targetThresholdFTE){
+        tag = timeSummaryStatus::underTarget;
+      }
+      item = {"Fraction of uptime " + displayFloat(frac*100, 0) +"% (target "+displayFloat(FTE*100, 0)+"%)", tag};
+      summary.push_back(item);
+
+      if(subs.size() > 0 and time+subTimes > 0){
+        // Has subprojects
+        for(auto & sub : subs){
+          item = {proj.name + ": " + sub.name, timeSummaryStatus::none};
+          summary.push_back(item);
+          auto subOnlyTime = sum.timeOn(sub.uid);
+          tag = timeSummaryStatus::onTarget;
+          frac = (float)subOnlyTime/(float)(time+subTimes); // Cannot be zero per if above
+          if(frac - sub.frac > targetThresholdFractionFrac){
+            tag = timeSummaryStatus::overTarget;
+          }else if(sub.frac - frac > targetThresholdFractionFrac){
+            tag = timeSummaryStatus::underTarget;
+          }
+          item = {"Fraction on sub " + displayFloat(frac*100, 0) +"% (target" +displayFloat(sub.frac*100,0)+"%)", tag};
+          summary.push_back(item);
+        }
+      }else if(subs.size() > 0){
+        //Has subprojects but nothing to show
+        item = {"No time expended, omitting subproject breakdown", timeSummaryStatus::none};
+        summary.push_back(item);
+      }
+    }
+    
+    //Adding total for one-offs
+    summary.push_back({"One Off Projects: "+ std::to_string(oneoffs)+" "+unit_str, timeSummaryStatus::none});
+    
+    return summary;
+  }
 
   public:
 
     TrackerData(appConfig config){
       if(config.backend == dataBackendType::database){
-        dataHandler = new databaseIO(config.dataFileName);
+        dataHandler = new databaseIO(config.dataFileName, config.durability);
       }else if(config.backend == dataBackendType::flatfile){
-        //dataHandler = new flatfileIO(config.dataFileName);
-        throw std::runtime_error("Flat file backend not implemented");
+        dataHandler = new flatfileIO(config.dataFileName, config.durability);
+      }else if(config.backend == dataBackendType::memory){
+        dataHandler = new memoryIO();
       }else{
         throw std::runtime_error("Unknown data backend type specified in config");
       }
+      if(config.asyncWrites){
+        asyncHandler = new asyncDataIO(dataHandler);
+        dataHandler = asyncHandler;
+      }
+      if(config.rebuildDigests){
+        std::cout<<"Rebuilding daily digests"<<std::endl;
+        dataHandler->rebuildDailyDigests();
+      }
     };
 
-    ~TrackerData(){if(dataHandler) delete dataHandler;};
+    /** \brief Use an existing data handler, e.g. one already filled for a test or benchmark. Takes ownership */
+    TrackerData(dataIO * handler) : dataHandler(handler){
+      if(!dataHandler) throw std::runtime_error("No Data Backend Found");
+    };
+
+    ~TrackerData(){
+      supersedeSummaries(); // A running summary stops at its next chunk, so the join below is short
+      delete summaryWorkers;
+      if(dataHandler) delete dataHandler;
+    };
 
     //Creating new projects - e.g from UI command
-    void createProject(const projectData & dat){
-      //Create a new project from data - adds it to the manager and writes to the backend
-      auto id = thePM.addProject(dat);
+    void createProject(const projectData & dat, timecode now){
+      //Create a new project from data - adds it to the manager and writes to the backend. Active or not as its dates say at now
+      auto id = thePM.addProject(dat, now);
       dataHandler->writeProject(fullProjectData(id, dat)); // Write to data handler
-      emit projectListUpdateEvent(thePM.getOrderedProjectList());
+      dataGeneration++;
+      emit projectListChangeEvent(thePM.takeListChanges());
       emit projectTotalUpdateEvent(thePM.allocatedFTE(), thePM.availableFTE());
     }
     void createSubproject(const subProjectData & dat, const proIds::Uuid & parentId){
       //Create a new sub under and existing project
       auto idS = thePM.addSubproject(dat, parentId);
       dataHandler->writeSubproject(fullSubProjectData(idS, dat, parentId)); // Write to data handler
-      emit projectListUpdateEvent(thePM.getOrderedProjectList());
+      dataGeneration++;
+      emit projectListChangeEvent(thePM.takeListChanges());
     }
 
     void createOneOff(proIds::Uuid uid, std::string name, std::string descr){
@@ -93,9 +371,15 @@ Q_OBJECT
       for(const auto & it : subprojectList){
         thePM.restoreSubproject(it);
       }
+      thePM.verifyAggregates(); // Once for the whole load - it walks every project
+      thePM.takeListChanges(); // The whole list goes out instead
       emit projectListUpdateEvent(thePM.getOrderedProjectList());
       emit projectTotalUpdateEvent(thePM.allocatedFTE(), thePM.availableFTE());
 
+      seedTotals();
+      rangeIndexBuilt = false;
+      dataGeneration++;
+
       // Check if there is an ongoing project
       try{
         auto latest = dataHandler->fetchLatestTrackerEntry();
@@ -120,7 +404,7 @@ Q_OBJECT
       currentProjectStatus.uid = uid;
       currentProjectStatus.status = trackerTypes::projectStatusFlag::active;
       currentProjectStatus.name = name;
-      dataHandler->writeTrackerEntry(stamp); // Write to data handler
+      recordStamp(stamp); // Write to data handler
       emit projectRunningUpdate(name); // Notify view that a project is running
 
     }
@@ -130,7 +414,7 @@ Q_OBJECT
         std::cout << "Stopping project with UID: " << currentProjectStatus.uid << std::endl;
         currentProjectStatus.status = trackerTypes::projectStatusFlag::none;
         emit projectStopped(); // Notify view that no project is running
-        dataHandler->writeTrackerEntry({now, proIds::NullUid});
+        recordStamp({now, proIds::NullUid});
       } //If nothing is active, do nothing
     }
     void pauseProject(timecode now){
@@ -142,7 +426,7 @@ Q_OBJECT
         }else{
           emit projectPaused(thePM.getName(currentProjectStatus.uid)); // Notify view that a project is running
         }
-        dataHandler->writeTrackerEntry({now, proIds::NullUid});
+        recordStamp({now, proIds::NullUid});
       } //If nothing is active, do nothing
     }
     void resumeProject(timecode now){
@@ -154,7 +438,7 @@ Q_OBJECT
         }else{
           emit projectRunningUpdate(thePM.getName(currentProjectStatus.uid)); // Notify view that a project is running
         }
-        dataHandler->writeTrackerEntry({now, currentProjectStatus.uid});
+        recordStamp({now, currentProjectStatus.uid});
       } //If nothing is paused, do nothing
     }
 
@@ -185,117 +469,122 @@ Q_OBJECT
     }
 
     void generateTimeSummary(timeSummaryUnit units){
-      std::vector<timeSummaryItem> summary;
-      // A vector of items to be displayed in order - expect display to add newlines between items
-
-      //TODO - add an FTE/week and compare absolute
-
-      const float targetThresholdFTE = 0.01;
-      const float targetThresholdFractionFrac = 0.01; // Ditto for sub fracs
-      //Fetching timedata - TODO limit bounds?
-      // TODO how to select time range for summary - c.f. View - filtering dialog and data struct?
-      std::vector<timeStamp> timestamps = dataHandler->fetchTrackerEntries();
-
-      if(timestamps.size() == 0){
-        summary.push_back({"No time entries found!", timeSummaryStatus::error});
-        emit timeSummaryReady(summary);
+      // TODO how to select time range for summary - c.f. View - filtering dialog and data struct? generateTimeSummaryBetween does the work
+      supersedeSummaries();
+      if(totals.empty()){
+        emit timeSummaryReady({{"No time entries found!", timeSummaryStatus::error}});
         return;
       }
 
-      std::cout<<"Fetched "<<timestamps.size()<<std::endl;
-
-      //TODO - should this always go until now? C.f. previous - time range selection?
-      timecode window = timeWrapper::toSeconds(timeWrapper::now()) - timestamps[0].time; 
-      std::map<proIds::Uuid, timecode> durations = timestampProcessor::stampsToDurations(timestamps);
-
-      std::string unit_str = unitToString(units);
-      timecode unit_factor = unitToDivisor(units);
-
+      // Range ends now, so the running totals answer it without going to the backend. Cached totals only need the running project's time carried on to now
+      timecode nowSecs = timeWrapper::toSeconds(timeWrapper::now());
+      auto * sum = cachedSummary(timecodeNull, timecodeNull);
+      if(!sum){
+        trackerTypes::summaryTotals fresh(totals.at(nowSecs), summaryProjects());
+        fresh.running = totals.latest().projectUid;
+        fresh.asOf = std::max(nowSecs, totals.latest().time);
+        sum = cacheSummary(timecodeNull, timecodeNull, dataGeneration, std::move(fresh));
+      }
+      sum->advanceTo(nowSecs);
+      timecode window = nowSecs - totals.firstStampTime();
       std::string tmp_str = displayFloatQuarters(window/timeFactors::day + 0.249); //Quarter day increment, rounding up
-      timeSummaryItem item = {"Showing summary for past " + tmp_str +" days", timeSummaryStatus::none};
-      summary.push_back(item);
+      emit timeSummaryReady(formatTimeSummary(units, *sum, "Showing summary for past " + tmp_str +" days"));
+    }
 
-      timecode uptime = 0, oneoffs = 0;
-      for(auto & item : durations){
-        uptime += item.second;
-        if(!thePM.isProject(item.first) && !thePM.isSubProject(item.first) && item.first != proIds::NullUid){
-          oneoffs += item.second;
-        } 
+    /** \brief Time summary for [start, end) only, e.g. from a date range picker
+     *
+     * Answered from the range index - two binary searches per entity, however long the history - and cached, so asking again in another unit only reformats. end should be no later than now
+     */
+    void generateTimeSummaryBetween(timeSummaryUnit units, timecode start, timecode end){
+      supersedeSummaries();
+      if(totals.empty()){
+        emit timeSummaryReady({{"No time entries found!", timeSummaryStatus::error}});
+        return;
       }
+      std::string header = "Showing summary from " + timeWrapper::formatTime(timeWrapper::fromSeconds(start)) + " to " + timeWrapper::formatTime(timeWrapper::fromSeconds(end));
+      auto * sum = cachedSummary(start, end);
+      if(!sum) sum = cacheSummary(start, end, dataGeneration, {durationsBetween(start, end), summaryProjects()});
+      emit timeSummaryReady(formatTimeSummary(units, *sum, header));
+    }
 
-      tmp_str = displayFloat(uptime/unit_factor, 1); //TODO rounding
-      item = {"Total uptime "+tmp_str+" "+unit_str, timeSummaryStatus::none};
-      summary.push_back(item);
-
-      // If there's no uptime, there's no point showing projects
-      if(uptime == 0){
-        summary.push_back({"Zero uptime - skipping project display", timeSummaryStatus::error});
-        emit timeSummaryReady(summary);
+    /**
+     * @brief As generateTimeSummaryBetween, but read and built on a worker thread with its own connection, so a long history does not hold up the GUI
+     *
+     * Reads only the stamps in range, so needs no range index. The result arrives through timeSummaryReady, with timeSummaryProgress along the way. Any later summary request supersedes this one - it stops at its next chunk and sends nothing. If the backend cannot give a reader, runs here instead.
+     * Shares the summary cache with generateTimeSummaryBetween - a range already summarised for the current data is answered at once
+     */
+    void requestTimeSummaryBetween(timeSummaryUnit units, timecode start, timecode end){
+      auto request = supersedeSummaries();
+      if(totals.empty()){
+        emit timeSummaryReady({{"No time entries found!", timeSummaryStatus::error}});
         return;
       }
-
-      // NOTE: from here we know uptime is non-zero and rely on this below
-
-      //Allowing tracking under top-level, OR sub
-      // Project totals are for main and all subs
-      // Fractions apply to subs against total project time
-      // Fractions should add to at most 1
-
-      auto projects = thePM.getOrderedProjectRefs();
-      for(auto & proj : projects){
-        auto subs = thePM.getOrderedSubRefs(*proj);
- 
-        item = {proj->getName(), timeSummaryStatus::none};
-        summary.push_back(item);
-
-        auto time = (durations.count(proj->getUid()) > 0) ?  durations[proj->getUid()] : 0; // Time on project itself
-        timecode subTimes = 0;
-        for(auto & sub : subs){
-          subTimes += (durations.count(sub->getUid()) > 0) ? durations[sub->getUid()] : 0; //Sum on subs
+      std::string header = "Showing summary from " + timeWrapper::formatTime(timeWrapper::fromSeconds(start)) + " to " + timeWrapper::formatTime(timeWrapper::fromSeconds(end));
+      if(auto * sum = cachedSummary(start, end)){
+        emit timeSummaryReady(formatTimeSummary(units, *sum, header));
+        return;
+      }
+      auto snap = summaryProjects();
+      auto generation = dataGeneration;
+      dataHandler->flush(); // Readers only see what has been committed
+      if(!summaryWorkers) summaryWorkers = new readerPool(*dataHandler);
+      if(!summaryWorkers->available()){
+        auto * sum = cacheSummary(start, end, generation, summariseRange(*dataHandler, request, start, end, snap, [this](int percent){emit timeSummaryProgress(percent);}));
+        emit timeSummaryReady(formatTimeSummary(units, *sum, header));
+        return;
+      }
+      summaryWorkers->submit([this, request, generation, units, start, end, header, snap](dataIO & reader){
+        // Off the GUI thread - results go back through its event loop, and are dropped there if superseded meanwhile
+        trackerTypes::summaryTotals sum;
+        try{
+          sum = summariseRange(reader, request, start, end, snap, [this, request](int percent){
+            QMetaObject::invokeMethod(this, [this, request, percent](){if(request == summaryRequest) emit timeSummaryProgress(percent);}, Qt::QueuedConnection);
+          });
+        }catch(const summarySuperseded &){
+          return;
+        }catch(const std::exception &e){
+          std::vector<timeSummaryItem> failed{{std::string("Summary failed: ") + e.what(), timeSummaryStatus::error}};
+          QMetaObject::invokeMethod(this, [this, request, failed](){if(request == summaryRequest) emit timeSummaryReady(failed);}, Qt::QueuedConnection);
+          return;
         }
+        QMetaObject::invokeMethod(this, [this, request, generation, units, start, end, header, sum](){
+          if(request != summaryRequest) return;
+          cacheSummary(start, end, generation, sum);
+          emit timeSummaryReady(formatTimeSummary(units, sum, header));
+        }, Qt::QueuedConnection);
+      });
+    }
+    /** \brief Drop any background summary still running or waiting */
+    void cancelTimeSummary(){
+      supersedeSummaries();
+    }
 
-        item = {"Time on project and subs: "+ displayFloatQuarters((time + subTimes)/unit_factor) + " "+unit_str, timeSummaryStatus::none};
-        summary.push_back(item);
-
-        float frac = (float)(time+subTimes)/(float)uptime; //See above - uptime cannot be zero here
-        float FTE = proj->getFTE();
-        timeSummaryStatus tag = timeSummaryStatus::onTarget;
-        if(frac - FTE > targetThresholdFTE){
-          tag = timeSummaryStatus::overTarget;
-        }else if(FTE - frac > targetThresholdFTE){
-          tag = timeSummaryStatus::underTarget;
-        }
-        item = {"Fraction of uptime " + displayFloat(frac*100, 0) +"% (target "+displayFloat(FTE*100, 0)+"%)", tag};
-        summary.push_back(item);
 
-        if(subs.size() > 0 and time+subTimes > 0){
-          // Has subprojects
-          for(auto & sub : subs){
-            item = {proj->getName() + ": " + sub->getName(), timeSummaryStatus::none};
-            summary.push_back(item);
-            auto subOnlyTime = durations.count(sub->getUid()) > 0 ? durations[sub->getUid()]: 0;
-            tag = timeSummaryStatus::onTarget;
-            frac = (float)subOnlyTime/(float)(time+subTimes); // Cannot be zero per if above
-            if(frac - sub->getFrac() > targetThresholdFractionFrac){
-              tag = timeSummaryStatus::overTarget;
-            }else if(sub->getFrac() - frac > targetThresholdFractionFrac){
-              tag = timeSummaryStatus::underTarget;
-            }
-            item = {"Fraction on sub " + displayFloat(frac*100, 0) +"% (target" +displayFloat(sub->getFrac()*100,0)+"%)", tag};
-            summary.push_back(item);
-          }
-        }else if(subs.size() > 0){
-          //Has subprojects but nothing to show
-          item = {"No time expended, omitting subproject breakdown", timeSummaryStatus::none};
-          summary.push_back(item);
-        }
+    /** \brief The entry in force at time - what was running then, or NullUid if paused or stopped. {timecodeNull, NullUid} if before any entry */
+    timeStamp activeAt(timecode time){
+      return dataHandler->fetchTrackerEntryAt(time);
+    }
+    /** \brief Report what was running at time, e.g. on arriving there by time travel */
+    void reportActiveAt(timecode time){
+      auto stamp = activeAt(time);
+      if(stamp.projectUid == proIds::NullUid){
+        std::cout << "Nothing running at " << timeWrapper::formatTime(timeWrapper::fromSeconds(time)) << std::endl;
+      }else{
+        std::cout << "At " << timeWrapper::formatTime(timeWrapper::fromSeconds(time)) << " " << thePM.getName(stamp.projectUid) << " was running, since " << timeWrapper::formatTime(timeWrapper::fromSeconds(stamp.time)) << std::endl;
       }
-      
-      //Adding total for one-offs
-      summary.push_back({"One Off Projects: "+ std::to_string(oneoffs)+" "+unit_str, timeSummaryStatus::none});
-      
-      emit timeSummaryReady(summary);
+    }
+
+    /** \brief Start and end projects whose dates have been reached - call as the clock moves, including on time travel. Sends one update for all that changed */
+    void updateProjectActivation(timecode now){
+      if(!thePM.updateActiveAt(now)) return;
+      dataGeneration++; // Changes which projects a summary lists
+      emit projectListChangeEvent(thePM.takeListChanges());
+      emit projectTotalUpdateEvent(thePM.allocatedFTE(), thePM.availableFTE());
+    }
 
+    /** \brief Commit batched writes which have reached their size or age limit - call periodically */
+    void flushPendingWrites(){
+      dataHandler->flush(true);
     }
 
     void handleCloseRequest(bool silent, timecode now){
@@ -309,14 +598,18 @@ Q_OBJECT
         stopProject(now);
 
       }
+      dataHandler->flush(); // Commit anything still in a write batch
+      if(asyncHandler) std::cout << asyncHandler->stats() << std::endl;
       emit readyToClose(); // Done, ready to shutdown now
     }
 
     signals:
       void projectListUpdateEvent(std::vector<selectableEntity> const & newList);
+      void projectListChangeEvent(std::vector<projectListDelta> const & changes); /**< \brief Signal emitted with the changes to the project list since it was last sent */
       void projectTotalUpdateEvent(float usedFTE, float freeFTE);
       void projectSummaryReady(std::string summary); /**< \brief Signal emitted when a summary is ready, with the summary text */
       void timeSummaryReady(std::vector<timeSummaryItem> summary);
+      void timeSummaryProgress(int percent); /**< \brief Signal emitted as a background time summary reads through its range, with the percentage done */
       void projectRunningUpdate(std::string name); /**< \brief Signal emitted when a project is running, with the name of the project */
       void projectPaused(std::string name); /**< \brief Signal emitted when a project is paused, with the name of the project */
       void projectStopped(); /**< \brief Signal emitted when no project is running */
@@ -20,26 +20,19 @@
 
 #include "support.h"
 #include "project.h"
+#include "projectListIndex.h"
 #include "projectbutton.h"
 #include "timeWrapper.h"
 
 
 inline TW_timePoint fromQDateTime(QDateTime time){
-  //Convert from QT time to app time, going via a string
-  // Format  "%Y-%m-%d %H:%M:%S"
-  std::string time_str;
-  time_str = time.toString("yyyy-MM-dd hh:mm:ss").toStdString();
-  return timeWrapper::parseTimeZoned(time_str);
+  //Convert from QT time to app time. Both count seconds from the epoch, so no need to go via a string
+  return timeWrapper::fromSeconds(time.toSecsSinceEpoch());
 }
 
 inline QDateTime toQDateTime(TW_timePoint time){
-  //Convert to QT time from app time, going via a string
-  // Format  "%Y-%m-%d %H:%M:%S"
-  std::string time_str;
-  time_str = timeWrapper::formatTime(time);
-  std::cout<<time_str<<std::endl;
-  //std::cout<<timeWrapper::formatTime(timeWrapper::parseTimeZoned(time_str))<<std::endl;
-  return QDateTime::fromString(QString::fromStdString(time_str),"yyyy-MM-dd hh:mm:ss");
+  //Convert to QT time (local) from app time
+  return QDateTime::fromSecsSinceEpoch(timeWrapper::toSeconds(time));
 }
 
 
@@ -62,6 +55,7 @@ Q_OBJECT
     float usedFTE = 0.0, freeFTE=0.0; //Tracks FTE fractions
     viewProperties prop; //TODO - should there be any way to alter this? - maybe settings and some presets?
     projectButton * oneOffTrackerButton = nullptr; // Tracker button for special entries
+    bool summaryFiltered = false; // Time summary shows the date range picked, not all time
 
   View(){
 
@@ -80,10 +74,25 @@ Q_OBJECT
     connect(ui->t_ttravel_button, &QPushButton::clicked, [this](){emit fetchTimeTravelInfo();});
 
     //Connecting Tab bar to refresh actions
-    connect(ui->tabWidget, &QTabWidget::currentChanged, [this](int index){if(index == 1) emit timeSummaryRequested(timeSummaryUnit::minute); if(index == 3) this->reportSelected();});
-    //TODO maybe use a call not a lambda
+    connect(ui->tabWidget, &QTabWidget::currentChanged, [this](int index){
+      if(index == 1){
+        summaryFiltered = false;
+        requestTimeSummary();
+      }else{
+        emit timeSummaryCancelled(); // Nothing left to show a range summary in
+      }
+      if(index == 3) this->reportSelected();
+    });
     //TODO - minutes for dev, -> hours for real
-    //TODO - add summary filtering dialog
+
+    // Summary unit and date range. A new choice supersedes any range summary still being built
+    ui->s_to_date->setDate(QDate::currentDate());
+    ui->s_from_date->setDate(QDate::currentDate().addDays(-30));
+    connect(ui->s_unit_box, &QComboBox::currentIndexChanged, [this](int){requestTimeSummary();});
+    connect(ui->s_filter_button, &QPushButton::clicked, [this](){
+      summaryFiltered = true;
+      requestTimeSummary();
+    });
 
 
     updateLFooter("Not Tracking");
@@ -232,6 +241,29 @@ Q_OBJECT
      
     }
 
+    /** \brief Apply changes to the project list - adds or removes just the buttons concerned
+     *
+     * Changes must be applied in order, to the list last sent by projectListUpdated. Tracker pane buttons sit at their list position, Projects pane ones at their place among top-level projects
+     */
+    void projectListChanged(std::vector<projectListDelta> const & changes){
+      auto tLayout = qobject_cast<QBoxLayout *>(ui->t_project_buttons->layout());
+      auto pLayout = ui->p_project_layout;
+      if(tLayout == nullptr){
+        std::cerr << "Error: t_project_buttons layout is null." << std::endl;
+        return;
+      }
+      for(auto & change : changes){
+        bool onPPane = change.entity.level == 0 && !change.entity.uid.isTaggedAs(proIds::uidTag::oneoff);
+        if(change.type == projectListDelta::change::inserted){
+          tLayout->insertWidget(int(change.position), makeTrackerButton(change.entity));
+          if(onPPane) pLayout->insertWidget(int(change.topPosition), makeViewButton(change.entity));
+        }else{
+          removeLayoutWidget(tLayout, int(change.position));
+          if(onPPane) removeLayoutWidget(pLayout, int(change.topPosition));
+        }
+      }
+    }
+
     void projectTimeUpdated(float usedFTE, float freeFTE){this->usedFTE = usedFTE; this->freeFTE = freeFTE;}
 
     void summaryDisplayUpdated(std::string summary){
@@ -361,6 +393,23 @@ Q_OBJECT
       }
 
     }
+    timeSummaryUnit selectedSummaryUnit(){
+      return ui->s_unit_box->currentIndex() == 1 ? timeSummaryUnit::hour : timeSummaryUnit::minute;
+    }
+    /** \brief Ask for the time summary as currently chosen - all time, or the picked days, in the picked unit */
+    void requestTimeSummary(){
+      if(summaryFiltered){
+        // Whole days, so the range runs to the start of the day after the last one picked
+        emit timeSummaryRangeRequested(selectedSummaryUnit(), ui->s_from_date->date().startOfDay(), ui->s_to_date->date().addDays(1).startOfDay());
+      }else{
+        emit timeSummaryRequested(selectedSummaryUnit());
+      }
+    }
+
+    /** \brief Stand in for a background time summary until it is ready */
+    void timeSummaryProgress(int percent){
+      timeSummaryUpdated({{"Summarising... " + std::to_string(percent) + "%", timeSummaryStatus::none}});
+    }
 
     void reportSelected(){
       //Need project details
@@ -375,6 +424,8 @@ Q_OBJECT
     void toplevelSummarySelected();
     void oneoffSummarySelected();
     void timeSummaryRequested(timeSummaryUnit unit);
+    void timeSummaryRangeRequested(timeSummaryUnit unit, QDateTime start, QDateTime end);
+    void timeSummaryCancelled();
     void pauseRequested(); /**< \brief Signal emitted when the pause button is clicked */
     void resumeRequested(); /**< \brief Signal emitted when the resume button is clicked */
     void stopRequested(); /**< \brief Signal emitted when the stop button is clicked */
@@ -392,6 +443,38 @@ Q_OBJECT
 
   private:
 
+    /** \brief Tracker pane button for a project or subproject */
+    projectButton * makeTrackerButton(selectableEntity const & proj){
+      projectButton * button = new projectButton();
+      button->projectId = proj.uid;
+      button->fullName = proj.name;
+      button->setText(QString::fromStdString(proj.name));
+      if(proj.level == 0){
+        button->setStyleSheet("background-color: lightblue;"); // Top level projects 
+      }else if(proj.level == 1){
+        button->setStyleSheet("background-color: lightgreen;"); // Subprojects
+      }
+      button->setFixedWidth(150);
+      connect(button, &projectButton::clicked, this, [this, button](){this->trackProjectClicked(button);});
+      return button;
+    }
+    /** \brief Projects pane button for a top-level project */
+    projectButton * makeViewButton(selectableEntity const & proj){
+      projectButton * button = new projectButton();
+      button->projectId = proj.uid;
+      button->fullName = proj.name;
+      button->setText(QString::fromStdString(proj.name));
+      button->setFixedWidth(100);
+      connect(button, &projectButton::clicked, this, [this, button](){this->viewProjectClicked(button);});
+      return button;
+    }
+    void removeLayoutWidget(QLayout * layout, int position){
+      QLayoutItem * child = layout->takeAt(position);
+      if(child == nullptr) return;
+      delete child->widget();
+      delete child;
+    }
+
     /** \brief Clear and replace Tracker pane buttons
      * 
      * Places projects and subprojects from the given list (expected in order) and adds a 'One Off' button at the end
@@ -407,18 +490,7 @@ Q_OBJECT
           delete child;
         }
         for (auto & proj : newList){
-          projectButton * button = new projectButton();
-          button->projectId = proj.uid;
-          button->fullName = proj.name;
-          button->setText(QString::fromStdString(proj.name));
-          if(proj.level == 0){
-            button->setStyleSheet("background-color: lightblue;"); // Top level projects 
-          }else if(proj.level == 1){
-            button->setStyleSheet("background-color: lightgreen;"); // Subprojects
-          }
-          button->setFixedWidth(150);
-          connect(button, &projectButton::clicked, this, [this, button](){this->trackProjectClicked(button);});
-          ui->t_project_buttons->layout()->addWidget(button);
+          ui->t_project_buttons->layout()->addWidget(makeTrackerButton(proj));
         }
         //Adding the 'one off' button - note this will 'waste' uids by getting a new one
         // with every added project but that is best alternative
@@ -451,14 +523,7 @@ Q_OBJECT
         }
         for (auto & proj : newList){ 
           if(proj.uid.isTaggedAs(proIds::uidTag::oneoff) || proj.uid.isTaggedAs(proIds::uidTag::sub)) continue; //Skips one-offs and subprojects
-          
-          projectButton * button = new projectButton();
-          button->projectId = proj.uid;
-          button->fullName = proj.name;
-          button->setText(QString::fromStdString(proj.name));
-          button->setFixedWidth(100);
-          connect(button, &projectButton::clicked, this, [this, button](){this->viewProjectClicked(button);});
-          ui->p_project_layout->layout()->addWidget(button);
+          ui->p_project_layout->layout()->addWidget(makeViewButton(proj));
         }
         //Adding hline
         auto line = new QFrame();
@@ -0,0 +1,87 @@
+#ifndef ____activationSchedule_h__
+#define ____activationSchedule_h__
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "idGenerators.h"
+#include "dataObjects.h"
+
+/**
+ * @brief Time-ordered queue of the moments projects start and end
+ *
+ * A project is active from its start through its end, inclusive, so it gains activity at start and loses it at end + 1. Each of those is held as a transition, ordered on time. Moving the schedule from one time to another - forwards as the clock runs, or either way on a time travel - hands back just the projects with a transition in between, one binary search to find out there are none.
+ * The schedule does not hold whether anything is active - the owner recomputes that for what it is handed, so crossing a start and an end together comes out right
+ */
+class activationSchedule{
+
+    std::multimap<timecode, proIds::Uuid> transitions;
+    timecode current = timecodeNull; /**< \brief Time the owner's state is for */
+
+    void erase(timecode t, const proIds::Uuid & uid){
+      auto range = transitions.equal_range(t);
+      for(auto it = range.first; it != range.second; ++it){
+        if(it->second == uid){
+          transitions.erase(it);
+          return;
+        }
+      }
+    }
+
+  public:
+    /** \brief Whether dates make a project active at t. Pass timecodeNull for no start or no end */
+    static bool activeAt(timecode start, timecode end, timecode t){
+      return (start == timecodeNull || start <= t) && (end == timecodeNull || end >= t);
+    }
+
+    /** \brief Schedule a project's transitions. Pass timecodeNull for no start or no end */
+    void add(const proIds::Uuid & uid, timecode start, timecode end){
+      if(start != timecodeNull) transitions.emplace(start, uid);
+      if(end != timecodeNull) transitions.emplace(end + 1, uid);
+    }
+    /** \brief Drop the transitions added for a project, with the same dates */
+    void remove(const proIds::Uuid & uid, timecode start, timecode end){
+      if(start != timecodeNull) erase(start, uid);
+      if(end != timecodeNull) erase(end + 1, uid);
+    }
+    void clear(){
+      transitions.clear();
+      current = timecodeNull;
+    }
+
+    timecode time() const{return current;}
+    /** \brief Set the time without handing anything back - for when the owner's state was computed at t */
+    void setTime(timecode t){current = t;}
+    size_t size() const{return transitions.size();}
+
+    /** \brief The first transition after the current time, or timecodeNull if there is none */
+    timecode next() const{
+      auto it = transitions.upper_bound(current);
+      return it == transitions.end() ? timecodeNull : it->first;
+    }
+
+    /**
+     * @brief Move to t, returning each project with a transition crossed on the way, once
+     *
+     * A transition at e is crossed when exactly one of the old and new times is at or after e. With no time set yet, just takes t
+     */
+    std::vector<proIds::Uuid> advanceTo(timecode t){
+      std::vector<proIds::Uuid> ret;
+      if(current == timecodeNull || t == current){
+        current = t;
+        return ret;
+      }
+      auto first = transitions.upper_bound(std::min(current, t));
+      auto last = transitions.upper_bound(std::max(current, t));
+      current = t;
+      for(auto it = first; it != last; ++it) ret.push_back(it->second);
+      if(ret.size() > 1){
+        std::sort(ret.begin(), ret.end());
+        ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+      }
+      return ret;
+    }
+};
+
+#endif
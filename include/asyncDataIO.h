@@ -0,0 +1,269 @@
+#ifndef ____asyncDataIO__
+#define ____asyncDataIO__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "dataInterface.h"
+
+/** \brief Fixed-size lock-free queue for ONE producer thread and ONE consumer thread
+*
+* Head is only written by the consumer, tail only by the producer, so plain acquire/release on the two indices is enough. Holds N-1 items
+*/
+template<typename T, size_t N>
+class spscRing{
+    std::array<T, N> cells;
+    std::atomic<size_t> head{0}; /**< \brief Next slot to pop */
+    std::atomic<size_t> tail{0}; /**< \brief Next slot to push */
+
+  public:
+    bool push(T && item){
+      size_t t = tail.load(std::memory_order_relaxed);
+      size_t next = (t + 1) % N;
+      if(next == head.load(std::memory_order_acquire)) return false; // Full
+      cells[t] = std::move(item);
+      tail.store(next, std::memory_order_release);
+      return true;
+    }
+    bool pop(T & out){
+      size_t h = head.load(std::memory_order_relaxed);
+      if(h == tail.load(std::memory_order_acquire)) return false; // Empty
+      out = std::move(cells[h]);
+      cells[h] = T();
+      head.store((h + 1) % N, std::memory_order_release);
+      return true;
+    }
+    size_t size() const{
+      size_t h = head.load(std::memory_order_acquire), t = tail.load(std::memory_order_acquire);
+      return (t + N - h) % N;
+    }
+    bool empty() const{return size() == 0;}
+};
+
+/** \brief Snapshot of background writer performance */
+struct writeQueueStats{
+  size_t queueDepth = 0; /**< \brief Writes waiting now */
+  size_t maxQueueDepth = 0; /**< \brief Most writes ever waiting at once */
+  unsigned long long writes = 0; /**< \brief Writes completed */
+  double meanLatencyUs = 0.0; /**< \brief Mean time from queueing to completion */
+  double maxLatencyUs = 0.0; /**< \brief Worst time from queueing to completion */
+};
+inline std::ostream& operator<< (std::ostream& stream, const writeQueueStats& st){
+  stream << st.writes << " background writes, mean latency " << st.meanLatencyUs << " us, max " << st.maxLatencyUs << " us, queue depth " << st.queueDepth << " (max " << st.maxQueueDepth << ")";
+  return stream;
+};
+
+/**
+ * @brief Data handler which does its writes on a background thread
+ *
+ * Wraps another dataIO. Writes are queued and return immediately, and a dedicated thread applies them in order, so a slow disk or locked database does not stall the caller.
+ * Reads first wait for the queue to drain (a barrier), then run on the calling thread - so they always see earlier writes, and never run alongside the writer.
+ * All calls must come from ONE thread (the queue has a single producer). A failed background write is reported by throwing from the next barrier
+ */
+class asyncDataIO : public dataIO{
+
+  struct pendingWrite{
+    std::function<void(dataIO &)> apply;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  std::unique_ptr<dataIO> inner; /**< \brief Handler doing the real work */
+  spscRing<pendingWrite, 4096> queue;
+  std::thread writer;
+  std::mutex wakeMutex; /**< \brief Only for sleeping and waking - the queue itself is lock-free */
+  std::condition_variable wake; /**< \brief Writer waits on this for work */
+  std::condition_variable drained; /**< \brief Barrier waits on this for completions */
+  bool stopping = false; /**< \brief Guarded by wakeMutex */
+  std::string writeError; /**< \brief First background failure since the last barrier. Guarded by wakeMutex */
+  unsigned long long enqueued = 0; /**< \brief Producer side count */
+  unsigned long long completed = 0; /**< \brief Guarded by wakeMutex */
+
+  std::atomic<size_t> maxDepth{0};
+  std::atomic<unsigned long long> totalLatencyNs{0}, maxLatencyNs{0};
+
+  void enqueue(std::function<void(dataIO &)> fn){
+    pendingWrite item{std::move(fn), std::chrono::steady_clock::now()};
+    while(!queue.push(std::move(item))){
+      wake.notify_one();
+      std::this_thread::yield(); // Full - let the writer catch up
+    }
+    enqueued++;
+    size_t depth = queue.size();
+    if(depth > maxDepth.load(std::memory_order_relaxed)) maxDepth.store(depth, std::memory_order_relaxed);
+    {std::lock_guard<std::mutex> lock(wakeMutex);} // Writer is either before its predicate check or waiting
+    wake.notify_one();
+  }
+
+  void writerLoop(){
+    pendingWrite item;
+    while(true){
+      while(queue.pop(item)){
+        std::string err;
+        try{
+          item.apply(*inner);
+        }catch(const std::exception &e){
+          err = e.what();
+        }
+        auto ns = (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - item.queued).count();
+        totalLatencyNs.fetch_add(ns, std::memory_order_relaxed);
+        if(ns > maxLatencyNs.load(std::memory_order_relaxed)) maxLatencyNs.store(ns, std::memory_order_relaxed);
+        {
+          std::lock_guard<std::mutex> lock(wakeMutex);
+          if(!err.empty() && writeError.empty()) writeError = err;
+          completed++;
+        }
+        drained.notify_all();
+      }
+      std::unique_lock<std::mutex> lock(wakeMutex);
+      if(stopping && queue.empty()) return;
+      wake.wait(lock, [this]{return stopping || !queue.empty();});
+    }
+  }
+
+  public:
+    asyncDataIO()=delete;
+    /** \brief Take ownership of inner and start the writer thread */
+    asyncDataIO(dataIO * inner_in) : inner(inner_in){
+      writer = std::thread(&asyncDataIO::writerLoop, this);
+    }
+    ~asyncDataIO(){
+      {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+      }
+      wake.notify_one();
+      writer.join(); // Drains anything left first
+      if(!writeError.empty()) std::cerr << "Background write failed: " << writeError << std::endl;
+    }
+
+    /** \brief Wait until everything queued so far has been applied
+     *
+     * @throws runtime_error if any of those writes failed
+     */
+    void barrier(){
+      std::unique_lock<std::mutex> lock(wakeMutex);
+      unsigned long long target = enqueued;
+      drained.wait(lock, [this, target]{return completed >= target;});
+      if(!writeError.empty()){
+        std::string err;
+        std::swap(err, writeError);
+        throw std::runtime_error("Background write failed: " + err);
+      }
+    }
+
+    writeQueueStats stats(){
+      writeQueueStats st;
+      st.queueDepth = queue.size();
+      st.maxQueueDepth = maxDepth.load();
+      {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        st.writes = completed;
+      }
+      if(st.writes > 0) st.meanLatencyUs = totalLatencyNs.load() / 1000.0 / st.writes;
+      st.maxLatencyUs = maxLatencyNs.load() / 1000.0;
+      return st;
+    }
+
+    // Writes - queued
+    void writeReferenceTime(timecode time) override{
+      enqueue([time](dataIO & io){io.writeReferenceTime(time);});
+    }
+    void writeProject(fullProjectData const &dat) override{
+      enqueue([dat](dataIO & io){io.writeProject(dat);});
+    }
+    void writeSubproject(fullSubProjectData const &dat) override{
+      enqueue([dat](dataIO & io){io.writeSubproject(dat);});
+    }
+    void writeOneOffProject(fullOneOffProjectData const & dat) override{
+      enqueue([dat](dataIO & io){io.writeOneOffProject(dat);});
+    }
+    void writeTrackerEntry(timeStamp const & stamp) override{
+      enqueue([stamp](dataIO & io){io.writeTrackerEntry(stamp);});
+    }
+    void rebuildDailyDigests() override{
+      enqueue([](dataIO & io){io.rebuildDailyDigests();});
+    }
+    void flush(bool onlyIfDue=false) override{
+      enqueue([onlyIfDue](dataIO & io){io.flush(onlyIfDue);});
+      if(!onlyIfDue) barrier(); // A periodic check should not block the caller
+    }
+    /** \brief A reader from the wrapped handler. Opened after a barrier, as for any other call on it */
+    dataIO * openReader() override{
+      barrier();
+      return inner->openReader();
+    }
+
+    // Reads - after a barrier, on the calling thread
+    fullProjectData readProject(proIds::Uuid const & id) override{
+      barrier();
+      return inner->readProject(id);
+    }
+    fullSubProjectData readSubproject(proIds::Uuid const & id) override{
+      barrier();
+      return inner->readSubproject(id);
+    }
+    fullOneOffProjectData readOneOffProject(proIds::Uuid const &id) override{
+      barrier();
+      return inner->readOneOffProject(id);
+    }
+    std::vector<fullProjectData> fetchProjectList() override{
+      barrier();
+      return inner->fetchProjectList();
+    }
+    std::vector<fullProjectData> fetchProjectListActiveAt(timecode date) override{
+      barrier();
+      return inner->fetchProjectListActiveAt(date);
+    }
+    std::vector<fullSubProjectData> fetchSubprojectList() override{
+      barrier();
+      return inner->fetchSubprojectList();
+    }
+    std::vector<fullSubProjectData> fetchSubprojectListForParents(std::vector<proIds::Uuid> ids) override{
+      barrier();
+      return inner->fetchSubprojectListForParents(ids);
+    }
+    std::vector<fullOneOffProjectData> fetchOneOffProjectList() override{
+      barrier();
+      return inner->fetchOneOffProjectList();
+    }
+    std::vector<fullOneOffProjectData> fetchOneOffProjectsInTimeRange(timecode start, timecode end) override{
+      barrier();
+      return inner->fetchOneOffProjectsInTimeRange(start, end);
+    }
+    std::vector<timeStamp> fetchTrackerEntries(timecode start=-1, timecode end=-1) override{
+      barrier();
+      return inner->fetchTrackerEntries(start, end);
+    }
+    void streamTrackerEntries(timeStampChunkSink sink, timecode start=-1, timecode end=-1) override{
+      barrier();
+      inner->streamTrackerEntries(sink, start, end);
+    }
+    timeStamp fetchLatestTrackerEntry() override{
+      barrier();
+      return inner->fetchLatestTrackerEntry();
+    }
+    timeStamp fetchEarliestTrackerEntry() override{
+      barrier();
+      return inner->fetchEarliestTrackerEntry();
+    }
+    timeStamp fetchTrackerEntryAt(timecode time) override{
+      barrier();
+      return inner->fetchTrackerEntryAt(time);
+    }
+    timeStamp fetchTrackerEntryAfter(timecode time) override{
+      barrier();
+      return inner->fetchTrackerEntryAfter(time);
+    }
+    std::vector<dailyDigest> fetchDailyDigests(timecode start=-1, timecode end=-1) override{
+      barrier();
+      return inner->fetchDailyDigests(start, end);
+    }
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef ____calendarBuckets_h__
+#define ____calendarBuckets_h__
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "idGenerators.h"
+#include "dataObjects.h"
+#include "timeWrapper.h"
+
+/** \brief Calendar unit to break time down by. Weeks are ISO - starting Monday */
+enum class calendarUnit{day, week, month};
+
+/** \brief Per-entity, per-bucket durations over a run of calendar buckets
+*
+* Bucket b covers [edges[b], edges[b+1]). Durations are a row-major matrix, one row per entity in entities, one column per bucket
+*/
+struct calendarBreakdown{
+  calendarUnit unit;
+  std::vector<timecode> edges; /**< \brief Bucket boundaries - local midnights - one more than the number of buckets */
+  std::vector<proIds::Uuid> entities; /**< \brief Entity for each row */
+  std::vector<timecode> durations; /**< \brief Seconds, entities.size() rows by buckets() columns */
+
+  size_t buckets() const{return edges.empty() ? 0 : edges.size() - 1;}
+  timecode at(size_t entity, size_t bucket) const{return durations[entity * buckets() + bucket];}
+  /** \brief Total over all buckets for one entity */
+  timecode rowTotal(size_t entity) const{
+    timecode total = 0;
+    for(size_t b = 0; b < buckets(); b++) total += at(entity, b);
+    return total;
+  }
+};
+
+/**
+ * @brief Breaks tracked time down into day, week or month buckets in one pass over ordered stamps
+ *
+ * The bucket boundaries for the whole range are worked out once, up front - one local time conversion per bucket, so DST changes land where they should - and each interval is then split against that table. Stamps only move forward, so finding a stamp's bucket is a step along the table, not a conversion.
+ * Intervals are credited to the stamp which opened them, as everywhere else. Untracked (NullUid) time is dropped. Time is clipped to [start, end), so the first and last buckets may be partial; the interval still open at the last stamp runs to end, so pass an end no later than now
+ */
+class calendarBucketer{
+
+    calendarUnit unit;
+    std::vector<timecode> edges;
+    timecode start, end;
+    proIds::uidInterner ids;
+    std::vector<std::vector<timecode>> rows; /**< \brief Per dense id, per bucket. Row for nullDenseId unused */
+    size_t cursor = 0; /**< \brief Bucket the last interval ended in */
+    timecode last = timecodeNull; /**< \brief Time the running interval opened */
+    proIds::denseId running = proIds::nullDenseId;
+
+    static long long bucketStart(calendarUnit unit, long long t){
+      if(unit == calendarUnit::week) return timeWrapper::weekStartSeconds(t);
+      if(unit == calendarUnit::month) return timeWrapper::monthStartSeconds(t);
+      return timeWrapper::dayStartSeconds(t);
+    }
+    static long long nextBucketStart(calendarUnit unit, long long t){
+      if(unit == calendarUnit::week) return timeWrapper::nextWeekStartSeconds(t);
+      if(unit == calendarUnit::month) return timeWrapper::nextMonthStartSeconds(t);
+      return timeWrapper::nextDayStartSeconds(t);
+    }
+
+    /** \brief Bucket containing t, which must be within the table, searching on from cur */
+    size_t locate(timecode t, size_t cur) const{
+      if(t < edges[cur]){
+        cur = std::upper_bound(edges.begin(), edges.end(), t) - edges.begin() - 1; // Out of order - search back
+      }
+      while(cur + 2 < edges.size() && t >= edges[cur + 1]) cur++;
+      return cur;
+    }
+    /** \brief Split [from, to), clipped to the range, across buckets of the running entity's row in into */
+    void credit(timecode from, timecode to, std::vector<std::vector<timecode>> & into, size_t & cur) const{
+      from = std::max(from, start);
+      to = std::min(to, end);
+      if(from >= to || running == proIds::nullDenseId) return;
+      if(running >= into.size()) into.resize(ids.size());
+      auto & row = into[running];
+      if(row.empty()) row.assign(edges.size() - 1, 0);
+      size_t b = locate(from, cur);
+      while(from < to){
+        timecode pieceEnd = std::min(to, edges[b + 1]);
+        row[b] += pieceEnd - from;
+        from = pieceEnd;
+        b++;
+      }
+      cur = b - 1;
+    }
+
+  public:
+    /** \brief Buckets covering [start_in, end_in). The first starts at or before start_in, the last ends at or after end_in. Stamps before start_in only set what is running */
+    calendarBucketer(calendarUnit unit_in, timecode start_in, timecode end_in) : unit(unit_in), start(start_in), end(end_in){
+      if(end <= start) throw std::runtime_error("Empty range for calendar breakdown");
+      edges = boundaries(unit, start, end);
+    }
+
+    /** \brief Boundary table for buckets covering [start, end). Costs one local time conversion per bucket */
+    static std::vector<timecode> boundaries(calendarUnit unit, timecode start, timecode end){
+      std::vector<timecode> ret;
+      ret.push_back(bucketStart(unit, start));
+      while(ret.back() < end) ret.push_back(nextBucketStart(unit, ret.back()));
+      return ret;
+    }
+
+    void add(const timeStamp & stamp){
+      if(last != timecodeNull) credit(last, stamp.time, rows, cursor);
+      last = stamp.time;
+      running = ids.intern(stamp.projectUid);
+    }
+    void add(const std::vector<timeStamp> & chunk){
+      for(auto & stamp : chunk) add(stamp);
+    }
+
+    /** \brief The matrix so far, with the open interval run to end. Entities appear in order of first sight */
+    calendarBreakdown result() const{
+      calendarBreakdown ret;
+      ret.unit = unit;
+      ret.edges = edges;
+      auto withOpen = rows; // Credit the open interval on a copy, so more stamps can still be added
+      size_t cur = cursor;
+      if(last != timecodeNull) credit(last, end, withOpen, cur);
+      for(size_t id = 0; id < withOpen.size(); id++){
+        if(withOpen[id].empty()) continue;
+        ret.entities.push_back(ids.uid(id));
+        ret.durations.insert(ret.durations.end(), withOpen[id].begin(), withOpen[id].end());
+      }
+      return ret;
+    }
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include "dataObjects.h"
 
 #include "databaseStore.h"
+#include "flatfileStore.h"
+#include "memoryStore.h"
 
 
 //Generic data reading and writing interface
@@ -35,14 +37,195 @@ class dataIO{
     virtual std::vector<fullOneOffProjectData> fetchOneOffProjectsInTimeRange(timecode start, timecode end) = 0;
 
     virtual std::vector<timeStamp> fetchTrackerEntries(timecode start=-1, timecode end=-1) = 0; /**< \brief Fetch ORDERED tracker entries from the data source, optionally within a time range */
+    virtual void streamTrackerEntries(timeStampChunkSink sink, timecode start=-1, timecode end=-1) = 0; /**< \brief Pass ORDERED tracker entries to sink in bounded chunks, optionally within a time range */
     virtual timeStamp fetchLatestTrackerEntry() = 0;/**< \brief Fetch the latest (most recent) tracker entry */
+    virtual timeStamp fetchEarliestTrackerEntry() = 0;/**< \brief Fetch the earliest (oldest) tracker entry */
+    virtual timeStamp fetchTrackerEntryAt(timecode time) = 0;/**< \brief Fetch the entry in force at time - the latest at or before it, whose uid is what was running (NullUid if paused or stopped). {timecodeNull, NullUid} if there is none that early. Logarithmic in the number of entries */
+    virtual timeStamp fetchTrackerEntryAfter(timecode time) = 0;/**< \brief Fetch the first entry strictly after time - the one ending the interval in force at time. {timecodeNull, NullUid} if there is none. Logarithmic in the number of entries */
+
+    virtual std::vector<dailyDigest> fetchDailyDigests(timecode start=-1, timecode end=-1) = 0; /**< \brief Fetch per-day, per-entity durations for days starting in the range, ordered by day */
+    virtual void rebuildDailyDigests() = 0; /**< \brief Recompute the daily digests from every tracker entry */
+
+    virtual void flush(bool onlyIfDue=false) = 0; /**< \brief Push any batched writes to the store. If onlyIfDue, only when the batch limits say so */
+
+    /** \brief A second handle onto the same data, for reads on another thread. Caller owns it
+     *
+     * Sees what this handle has flushed, not what is still batched. Null if the backend cannot share its data safely
+     */
+    virtual dataIO * openReader(){return nullptr;}
 
 };
 
+/**
+ * @brief Data handling class implementing dataIO interface using append-only flat files
+ *
+ * fileName is a base name - the store adds its own extensions
+ */
 class flatfileIO : public dataIO{
+
+  flatfileStore fileStore; /**< \brief Flat file store handling the files */
+
   public:
-    flatfileIO(){;};
+    flatfileIO()=delete;
+    flatfileIO(std::string fileName, durabilityConfig dur = durabilityConfig()): fileStore(fileName, dur){;}; /**< \brief Constructor with base file name and durability settings */
     ~flatfileIO(){;};
+    void writeReferenceTime(timecode /*time*/) override {
+      std::cerr<<"Writing reference time not implemented yet."<<std::endl;
+    }
+    void writeProject(fullProjectData const &dat) override {
+      fileStore.writeProject(dat);
+    }
+    fullProjectData readProject(proIds::Uuid const & id ) override {
+      return fileStore.readProject(id);
+    }
+    void writeSubproject(fullSubProjectData const &dat) override {
+      fileStore.writeSubProject(dat);
+    }
+    fullSubProjectData readSubproject(proIds::Uuid const & id) override {
+      return fileStore.readSubproject(id);
+    }
+    void writeOneOffProject(fullOneOffProjectData const & dat) override{
+      fileStore.writeOneOff(dat);
+    }
+    fullOneOffProjectData readOneOffProject(proIds::Uuid const &id) override{
+      return fileStore.readOneOff(id);
+    }
+    void writeTrackerEntry(timeStamp const & stamp) override {
+      fileStore.writeTrackerEntry(stamp);
+    }
+    std::vector<fullProjectData> fetchProjectList() override {
+      return fileStore.fetchProjectList();
+    }
+    std::vector<fullProjectData> fetchProjectListActiveAt(timecode date) override {
+      return fileStore.fetchProjectListActiveAt(date);
+    }
+    std::vector<fullSubProjectData> fetchSubprojectList() override {
+      return fileStore.fetchSubprojectList();
+    }
+    std::vector<fullSubProjectData> fetchSubprojectListForParents(std::vector<proIds::Uuid> ids) override{
+      return fileStore.fetchSubprojectListForParents(ids);
+    }
+    std::vector<fullOneOffProjectData> fetchOneOffProjectList() override{
+      return fileStore.fetchOneOffList();
+    }
+    std::vector<fullOneOffProjectData> fetchOneOffProjectsInTimeRange(timecode start, timecode end) override{
+      return fileStore.fetchOneOffsInRange(start, end);
+    }
+    std::vector<timeStamp> fetchTrackerEntries(timecode start=-1, timecode end=-1) override {
+      return fileStore.fetchTrackerEntries(start, end);
+    }
+    void streamTrackerEntries(timeStampChunkSink sink, timecode start=-1, timecode end=-1) override {
+      fileStore.streamTrackerEntries(sink, start, end);
+    }
+    timeStamp fetchLatestTrackerEntry() override{
+      return fileStore.fetchLatestTrackerEntry();
+    }
+    timeStamp fetchEarliestTrackerEntry() override{
+      return fileStore.fetchEarliestTrackerEntry();
+    }
+    timeStamp fetchTrackerEntryAt(timecode time) override{
+      return fileStore.fetchTrackerEntryAt(time);
+    }
+    timeStamp fetchTrackerEntryAfter(timecode time) override{
+      return fileStore.fetchTrackerEntryAfter(time);
+    }
+    std::vector<dailyDigest> fetchDailyDigests(timecode start=-1, timecode end=-1) override{
+      return fileStore.fetchDailyDigests(start, end);
+    }
+    void rebuildDailyDigests() override{
+      // Digests are computed from the stamps on every fetch, nothing to rebuild
+    }
+    void flush(bool onlyIfDue=false) override{
+      fileStore.flush(onlyIfDue);
+    }
+    // No openReader - opening the files again would re-run tail recovery under the writer
+};
+
+/**
+ * @brief Data handling class implementing dataIO interface in memory
+ *
+ * Nothing is saved - for tests, benchmarks, and report runs which load data and exit. Isolates the cost of the code above dataIO from any disk
+ */
+class memoryIO : public dataIO{
+
+  memoryStore memStore; /**< \brief Store holding all the data */
+
+  public:
+    memoryIO(){;};
+    ~memoryIO(){;};
+    void writeReferenceTime(timecode /*time*/) override {
+      std::cerr<<"Writing reference time not implemented yet."<<std::endl;
+    }
+    void writeProject(fullProjectData const &dat) override {
+      memStore.writeProject(dat);
+    }
+    fullProjectData readProject(proIds::Uuid const & id ) override {
+      return memStore.readProject(id);
+    }
+    void writeSubproject(fullSubProjectData const &dat) override {
+      memStore.writeSubProject(dat);
+    }
+    fullSubProjectData readSubproject(proIds::Uuid const & id) override {
+      return memStore.readSubproject(id);
+    }
+    void writeOneOffProject(fullOneOffProjectData const & dat) override{
+      memStore.writeOneOff(dat);
+    }
+    fullOneOffProjectData readOneOffProject(proIds::Uuid const &id) override{
+      return memStore.readOneOff(id);
+    }
+    void writeTrackerEntry(timeStamp const & stamp) override {
+      memStore.writeTrackerEntry(stamp);
+    }
+    std::vector<fullProjectData> fetchProjectList() override {
+      return memStore.fetchProjectList();
+    }
+    std::vector<fullProjectData> fetchProjectListActiveAt(timecode date) override {
+      return memStore.fetchProjectListActiveAt(date);
+    }
+    std::vector<fullSubProjectData> fetchSubprojectList() override {
+      return memStore.fetchSubprojectList();
+    }
+    std::vector<fullSubProjectData> fetchSubprojectListForParents(std::vector<proIds::Uuid> ids) override{
+      return memStore.fetchSubprojectListForParents(ids);
+    }
+    std::vector<fullOneOffProjectData> fetchOneOffProjectList() override{
+      return memStore.fetchOneOffList();
+    }
+    std::vector<fullOneOffProjectData> fetchOneOffProjectsInTimeRange(timecode start, timecode end) override{
+      return memStore.fetchOneOffsInRange(start, end);
+    }
+    std::vector<timeStamp> fetchTrackerEntries(timecode start=-1, timecode end=-1) override {
+      return memStore.fetchTrackerEntries(start, end);
+    }
+    void streamTrackerEntries(timeStampChunkSink sink, timecode start=-1, timecode end=-1) override {
+      memStore.streamTrackerEntries(sink, start, end);
+    }
+    timeStamp fetchLatestTrackerEntry() override{
+      return memStore.fetchLatestTrackerEntry();
+    }
+    timeStamp fetchEarliestTrackerEntry() override{
+      return memStore.fetchEarliestTrackerEntry();
+    }
+    timeStamp fetchTrackerEntryAt(timecode time) override{
+      return memStore.fetchTrackerEntryAt(time);
+    }
+    timeStamp fetchTrackerEntryAfter(timecode time) override{
+      return memStore.fetchTrackerEntryAfter(time);
+    }
+    std::vector<dailyDigest> fetchDailyDigests(timecode start=-1, timecode end=-1) override{
+      return memStore.fetchDailyDigests(start, end);
+    }
+    void rebuildDailyDigests() override{
+      // Digests are computed from the stamps on every fetch, nothing to rebuild
+    }
+    void flush(bool /*onlyIfDue*/=false) override{
+      // Nothing is buffered
+    }
+    /** \brief Pre-allocate for a known number of tracker entries, e.g. before a bulk load */
+    void reserveTrackerEntries(size_t count){
+      memStore.reserve(count);
+    }
 };
 
 /**
@@ -53,11 +236,13 @@ class flatfileIO : public dataIO{
  */
 class databaseIO : public dataIO{
 
+  std::string dbFileName; /**< \brief For opening readers */
+  durabilityConfig durability;
   databaseStore dbStore; /**< \brief Database store for handling database operations */
 
   public:
     databaseIO()=delete;
-    databaseIO(std::string fileName): dbStore(fileName){;}; /**< \brief Constructor with file name */
+    databaseIO(std::string fileName, durabilityConfig dur = durabilityConfig()): dbFileName(fileName), durability(dur), dbStore(fileName, dur){;}; /**< \brief Constructor with file name and durability settings */
     ~databaseIO(){;};
     void writeReferenceTime(timecode time) override {
       // Implementation for writing reference time to database
@@ -118,9 +303,41 @@ class databaseIO : public dataIO{
       // Implementation for fetching tracker entries from database
       return dbStore.fetchTrackerEntries(start, end);
     }
+    void streamTrackerEntries(timeStampChunkSink sink, timecode start=-1, timecode end=-1) override {
+      dbStore.streamTrackerEntries(sink, start, end);
+    }
     timeStamp fetchLatestTrackerEntry() override{
       return dbStore.fetchLatestTrackerEntry();
     }
+    timeStamp fetchEarliestTrackerEntry() override{
+      return dbStore.fetchEarliestTrackerEntry();
+    }
+    timeStamp fetchTrackerEntryAt(timecode time) override{
+      return dbStore.fetchTrackerEntryAt(time);
+    }
+    timeStamp fetchTrackerEntryAfter(timecode time) override{
+      return dbStore.fetchTrackerEntryAfter(time);
+    }
+    std::vector<dailyDigest> fetchDailyDigests(timecode start=-1, timecode end=-1) override{
+      return dbStore.fetchDailyDigests(start, end);
+    }
+    void rebuildDailyDigests() override{
+      dbStore.rebuildDailyDigests();
+    }
+    /** \brief Whether the timestamp queries are index-backed - see databaseStore::checkQueryPlans */
+    bool checkQueryPlans(){
+      return dbStore.checkQueryPlans();
+    }
+    void flush(bool onlyIfDue=false) override{
+      dbStore.flush(onlyIfDue);
+    }
+    /** \brief A separate connection to the same file, under WAL only - there readers and the writer do not block each other. Under a rollback journal a long read would lock out writes, so none is given */
+    dataIO * openReader() override{
+      if(durability.journal != journalMode::wal) return nullptr;
+      durabilityConfig readerDur = durability;
+      readerDur.groupCommitSize = 1; // Writes nothing, so nothing to batch
+      return new databaseIO(dbFileName, readerDur);
+    }
 };
 
 #endif
\ No newline at end of file
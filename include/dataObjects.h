@@ -11,6 +11,8 @@
 
 #include <string>
 #include <iostream>
+#include <functional>
+#include <vector>
 
 #include "support.h"
 #include "idGenerators.h"
@@ -161,6 +163,37 @@ inline std::ostream& operator<< (std::ostream& stream, const timeStamp& ts){
   return stream;
 };
 
+/** \brief A timeStamp with its entity as a dense id from a proIds::uidInterner */
+class internedStamp{
+    public:
+    timecode time;
+    proIds::denseId id;
+};
+
+/** \brief Consumer for streamed tracker entries
+*
+* Called with successive chunks, in time order. The chunk is only valid for the duration of the call
+*/
+using timeStampChunkSink = std::function<void(const std::vector<timeStamp> &)>;
+inline const size_t stampChunkSize = 4096; /**< \brief Default number of entries per streamed chunk */
+
+/** \brief Time spent on one entity during one local day
+*
+* Materialised from the tracker entries, so summaries can read one row per day and entity instead of every stamp. Untracked (NullUid) time is not stored
+*/
+class dailyDigest{
+    public:
+    timecode day; /**< \brief Local midnight starting the day */
+    proIds::Uuid entityUid; /**< \brief Entity the time was spent on */
+    timecode duration; /**< \brief Seconds spent on entity during the day */
+};
+inline std::ostream& operator<< (std::ostream& stream, const dailyDigest& dg){
+/** \brief Stream operator for dailyDigest
+*/
+  stream << "Day: " << dg.day << ", Project UID: " << dg.entityUid << ", Duration: " << dg.duration;
+  return stream;
+};
+
 inline bool operator<(const timeStamp &lhs, const timeStamp &rhs){
   return lhs.time < rhs.time;
 };
@@ -1,25 +1,135 @@
 #ifndef DATABASESTORE_H
 #define DATABASESTORE_H
 
+#include <chrono>
+#include <climits>
 #include <iostream>
 #include <string>
+#include <unordered_map>
 
 #include <sqlite3.h>
 
 #include "dataObjects.h"
 #include "idGenerators.h"
+#include "timestampProcessor.h"
+
+
+/** \brief Scoped use of a cached prepared statement
+ *
+ * Resets the statement and clears its bindings when it goes out of scope, so early returns and throws leave the cached statement ready for the next call. Does NOT own the statement - the cache does
+ */
+class cachedStatement{
+    sqlite3_stmt * stmt; /**< \brief Statement owned by the databaseStore cache */
+  public:
+    cachedStatement(sqlite3_stmt * stmt_in) : stmt(stmt_in){;};
+    cachedStatement(const cachedStatement &other) = delete;
+    ~cachedStatement(){sqlite3_reset(stmt); sqlite3_clear_bindings(stmt);};
+    operator sqlite3_stmt*() const{return stmt;}
+};
 
+/** \brief SQL for the timestamp queries which must stay index-backed
+ *
+ * Shared between the fetch methods and the query plan check, so the check always sees the real query.
+ * Equal times are ordered by id - the order written - as the other backends order them, so a stop in the same second as a start wins
+ */
+namespace trackerQueries{
+    inline const std::string all = "SELECT time, project_id from timestamps t ORDER BY time, id;";
+    inline const std::string from = "SELECT time, project_id from timestamps t WHERE t.time >= ?1 ORDER BY time, id;";
+    inline const std::string upTo = "SELECT time, project_id from timestamps t WHERE t.time <= ?2 ORDER BY time, id;";
+    inline const std::string range = "SELECT time, project_id from timestamps t WHERE t.time >= ?1 AND t.time <= ?2 ORDER BY time, id;";
+    inline const std::string latest = "SELECT time, project_id from timestamps t ORDER BY time DESC, id DESC LIMIT 1;";
+    inline const std::string earliest = "SELECT time, project_id from timestamps t ORDER BY time, id LIMIT 1;";
+    inline const std::string atOrBefore = "SELECT time, project_id from timestamps t WHERE t.time <= ?1 ORDER BY time DESC, id DESC LIMIT 1;";
+    inline const std::string after = "SELECT time, project_id from timestamps t WHERE t.time > ?1 ORDER BY time, id LIMIT 1;";
+    inline const std::string digestRange = "SELECT day, entity_id, duration from digests d WHERE d.day >= ?1 AND d.day <= ?2 ORDER BY day;";
+    inline const std::string subprojectsForParents = "SELECT id, name, frac, parent_id FROM subprojects WHERE parent_id IN (SELECT id FROM temp.parent_filter) ORDER BY parent_id, name;"; // IN, not a join - the planner would scan subprojects, probing the unanalysed filter
+    inline const std::string oneOffsInRange = "SELECT ts.time, oo.id, oo.name, oo.descr FROM timestamps AS ts INNER JOIN oneoffs AS oo ON ts.project_id = oo.id WHERE ts.time > ? and ts.time < ?;";
+}
 
 class databaseStore{
 
-    sqlite3 *DB; /**< \brief SQLite database connection */
+    sqlite3 *DB = nullptr; /**< \brief SQLite database connection */
     std::string dbFileName; /**< \brief Name of the database file */
     char *errMsg = nullptr; /**< \brief Error message from SQLite operations */
+    std::unordered_map<std::string, sqlite3_stmt *> stmtCache; /**< \brief Prepared statements keyed on their SQL text. Finalized in destructor */
+    durabilityConfig durability; /**< \brief Journal, sync and group-commit settings */
+    int pendingWrites = 0; /**< \brief Tracker entries in the open group-commit transaction. 0 if none is open */
+    std::chrono::steady_clock::time_point batchOpened; /**< \brief When the open group-commit transaction began */
+    timeStamp lastStamp{timecodeNull, proIds::NullUid}; /**< \brief Latest tracker entry, which opened the interval the next write will close */
+    bool lastStampKnown = false; /**< \brief lastStamp has been read from the table. Loaded on first write */
+    localDayCache digestDays; /**< \brief Day bounds for splitting new intervals */
+
+    /** \brief Get a prepared statement for the given SQL
+     *
+     * Statements are prepared on first use and kept in the cache, so repeat calls only pay for reset and rebind
+     * @param cmd SQL text - use the SAME string for the same query, bind values rather than splicing them in
+     * @returns Scoped handle which resets the statement on exit
+     */
+    cachedStatement prepare(const std::string & cmd){
+        auto it = stmtCache.find(cmd);
+        if(it != stmtCache.end()) return cachedStatement(it->second);
+
+        sqlite3_stmt * stmt = nullptr;
+        int err = sqlite3_prepare_v3(DB, cmd.c_str(), cmd.length(), SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+        if(err != SQLITE_OK){
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(DB) << std::endl;
+            sqlite3_finalize(stmt);
+            throw std::runtime_error("Failed to prepare statement");
+        }
+        stmtCache[cmd] = stmt;
+        return cachedStatement(stmt);
+    }
+    /** \brief Finalize all cached statements */
+    void clear_statement_cache(){
+        for(auto & it : stmtCache) sqlite3_finalize(it.second);
+        stmtCache.clear();
+    }
 
     void enable_foreign_keys(){sqlite3_exec(DB, "PRAGMA foreign_keys = ON", nullptr, nullptr, nullptr);}
+    void run_command(const std::string & cmd, const std::string & what){
+        int err = sqlite3_exec(DB, cmd.c_str(), NULL, NULL, &errMsg);
+        if(err != SQLITE_OK){
+            std::cerr << "Error in " << what << ": " << errMsg << std::endl;
+            sqlite3_free(errMsg);
+            throw std::runtime_error("Failed to " + what);
+        }
+    }
+    void apply_durability(){
+        // journal_mode reports the mode actually in use, so read it back rather than exec
+        std::string cmd = durability.journal == journalMode::wal ? "PRAGMA journal_mode = WAL;" : "PRAGMA journal_mode = DELETE;";
+        cachedStatement prep_cmd = prepare(cmd);
+        if(sqlite3_step(prep_cmd) == SQLITE_ROW){
+            std::cout << "Journal mode: " << reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 0)) << std::endl;
+        }
+        if(durability.sync == syncLevel::off){
+            run_command("PRAGMA synchronous = OFF;", "set synchronous level");
+        }else if(durability.sync == syncLevel::normal){
+            run_command("PRAGMA synchronous = NORMAL;", "set synchronous level");
+        }else{
+            run_command("PRAGMA synchronous = FULL;", "set synchronous level");
+        }
+    }
+    static void bind_uid(sqlite3_stmt * stmt, int index, const proIds::Uuid & id){
+        QByteArray bytes = id.to_bytes();
+        sqlite3_bind_blob(stmt, index, bytes.constData(), bytes.size(), SQLITE_TRANSIENT);
+    }
+    static proIds::Uuid column_uid(sqlite3_stmt * stmt, int col){
+        const void * bytes = sqlite3_column_blob(stmt, col); // Must be called before column_bytes
+        return proIds::Uuid(bytes, sqlite3_column_bytes(stmt, col));
+    }
+    bool batching() const{return durability.groupCommitSize > 1;}
+    bool batchDue() const{
+        if(pendingWrites >= durability.groupCommitSize) return true;
+        return std::chrono::steady_clock::now() - batchOpened >= std::chrono::milliseconds(durability.groupCommitWindowMs);
+    }
     bool check_tables(){
 
-        auto expected_tables = std::vector<std::string>{"projects", "subprojects", "timestamps", "app_data", "oneoffs"};
+        if(get_schema_version() > latest_schema_version()){
+            std::cerr << "Database schema version " << get_schema_version() << " is newer than supported version " << latest_schema_version() << std::endl;
+            throw std::runtime_error("Database was written by a newer version");
+        }
+
+        auto expected_tables = std::vector<std::string>{"projects", "subprojects", "timestamps", "app_data", "oneoffs", "digests"};
         // Get list of tables in the database
         std::string cmd = "SELECT name FROM sqlite_master WHERE type='table';";
         sqlite3_stmt *stmt;
@@ -47,16 +157,250 @@ class databaseStore{
         return true;
     }
 
+    /** \brief One schema upgrade step
+     *
+     * Steps run in version order on open, each in its own transaction which also sets user_version, so an interrupted upgrade resumes from the last completed step. Append new steps, never edit old ones
+     */
+    struct schemaMigration{
+        int version; /**< \brief user_version once this step is applied */
+        std::string description;
+        void (databaseStore::*apply)();
+    };
+    static const std::vector<schemaMigration> & migrations(){
+        static const std::vector<schemaMigration> steps = {
+            {1, "store ids as 16 byte BLOBs", &databaseStore::migrate_ids_to_blob},
+            {2, "index timestamps by time and by entity, subprojects by parent", &databaseStore::migrate_add_indexes},
+            {3, "add daily per-entity digests", &databaseStore::migrate_add_digests},
+            {4, "index timestamps by time then write order", &databaseStore::migrate_index_write_order},
+        };
+        return steps;
+    }
+    static int latest_schema_version(){return migrations().back().version;}
+
+    void run_migrations(){
+        int current = get_schema_version();
+        for(auto & step : migrations()){
+            if(step.version <= current) continue;
+            std::cout << "Applying schema migration " << step.version << ": " << step.description << std::endl;
+            (this->*step.apply)();
+            current = get_schema_version();
+            if(current != step.version) throw std::runtime_error("Schema migration did not reach expected version");
+        }
+    }
+    /** \brief Run SQL for a simple migration step in a transaction, setting the version on success */
+    void run_migration_sql(const std::string & cmd, int version){
+        clear_statement_cache(); // Plans may change under a new schema
+        try{
+            run_command("BEGIN;" + cmd + "PRAGMA user_version = " + std::to_string(version) + ";COMMIT;", "apply schema migration " + std::to_string(version));
+        }catch(const std::runtime_error &e){
+            sqlite3_exec(DB, "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw;
+        }
+    }
+
+    int get_schema_version(){
+        cachedStatement prep_cmd = prepare("PRAGMA user_version;");
+        if(sqlite3_step(prep_cmd) != SQLITE_ROW){
+            throw std::runtime_error("Failed to read schema version");
+        }
+        return sqlite3_column_int(prep_cmd, 0);
+    }
+
+    static void uuid_to_blob_sql(sqlite3_context * ctx, int /*argc*/, sqlite3_value ** argv){
+        // SQL function for migrations - converts a text id to its 16 byte form. Blobs and NULL pass through unchanged
+        if(sqlite3_value_type(argv[0]) != SQLITE_TEXT){
+            sqlite3_result_value(ctx, argv[0]);
+            return;
+        }
+        proIds::Uuid id(std::string(reinterpret_cast<const char *>(sqlite3_value_text(argv[0]))));
+        QByteArray bytes = id.to_bytes();
+        sqlite3_result_blob(ctx, bytes.constData(), bytes.size(), SQLITE_TRANSIENT);
+    }
+
+    /** \brief Rewrite all id columns as 16 byte BLOBs, in place
+     *
+     * Schema version 0 used CHAR(36) text ids. Each table is rebuilt with BLOB columns and the ids converted on copy, all in one transaction. Foreign keys must be off around a rebuild, and can only be toggled outside a transaction
+     */
+    void migrate_ids_to_blob(){
+        std::cout << "Migrating ids to BLOB storage" << std::endl;
+        clear_statement_cache(); // Cached statements refer to the old tables
+        sqlite3_create_function_v2(DB, "uuid_to_blob", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr, &uuid_to_blob_sql, nullptr, nullptr, nullptr);
+        run_command("PRAGMA foreign_keys = OFF;", "disable foreign keys for migration");
+        try{
+            run_command(
+                "BEGIN;"
+                "CREATE TABLE projects_new(id BLOB PRIMARY KEY, name TEXT, FTE REAL, start_date INTEGER, end_date INTEGER);"
+                "INSERT INTO projects_new SELECT uuid_to_blob(id), name, FTE, start_date, end_date FROM projects;"
+                "CREATE TABLE subprojects_new(id BLOB PRIMARY KEY, name TEXT, frac REAL, parent_id BLOB, FOREIGN KEY(parent_id) REFERENCES projects(id));"
+                "INSERT INTO subprojects_new SELECT uuid_to_blob(id), name, frac, uuid_to_blob(parent_id) FROM subprojects;"
+                "CREATE TABLE oneoffs_new(id BLOB PRIMARY KEY, name TEXT, descr TEXT);"
+                "INSERT INTO oneoffs_new SELECT uuid_to_blob(id), name, descr FROM oneoffs;"
+                "CREATE TABLE timestamps_new(id INTEGER PRIMARY KEY, time INTEGER, project_id BLOB);"
+                "INSERT INTO timestamps_new SELECT id, time, uuid_to_blob(project_id) FROM timestamps;"
+                "DROP TABLE subprojects; DROP TABLE projects; DROP TABLE oneoffs; DROP TABLE timestamps;"
+                "ALTER TABLE projects_new RENAME TO projects;"
+                "ALTER TABLE subprojects_new RENAME TO subprojects;"
+                "ALTER TABLE oneoffs_new RENAME TO oneoffs;"
+                "ALTER TABLE timestamps_new RENAME TO timestamps;"
+                "PRAGMA user_version = 1;", "migrate ids to BLOB");
+            {
+                cachedStatement check = prepare("PRAGMA foreign_key_check;");
+                if(sqlite3_step(check) == SQLITE_ROW) throw std::runtime_error("Foreign key violation after id migration");
+            }
+            clear_statement_cache();
+            run_command("COMMIT;", "commit id migration");
+        }catch(const std::runtime_error &e){
+            clear_statement_cache();
+            sqlite3_exec(DB, "ROLLBACK;", nullptr, nullptr, nullptr);
+            enable_foreign_keys();
+            throw;
+        }
+        enable_foreign_keys();
+    }
+
+    void migrate_add_indexes(){
+        // (time, project_id) covers the ordered and ranged fetches and latest-entry lookup without touching the table
+        // (project_id, time) serves joins and per-entity lookups
+        run_migration_sql(
+            "CREATE INDEX IF NOT EXISTS timestamps_by_time ON timestamps(time, project_id);"
+            "CREATE INDEX IF NOT EXISTS timestamps_by_entity ON timestamps(project_id, time);"
+            "CREATE INDEX IF NOT EXISTS subprojects_by_parent ON subprojects(parent_id, name);", 2);
+    }
+
+    /** \brief Re-index timestamps so equal times come back in the order written, not by uid
+     *
+     * (time, id, project_id) still covers the fetches in both directions. Digests were credited with the old order, so are rebuilt
+     */
+    void migrate_index_write_order(){
+        clear_statement_cache(); // Plans change with the index
+        try{
+            run_command("BEGIN;"
+                "DROP INDEX IF EXISTS timestamps_by_time;"
+                "CREATE INDEX timestamps_by_time ON timestamps(time, id, project_id);", "re-index timestamps");
+            clear_statement_cache();
+            rebuild_digests();
+            clear_statement_cache();
+            run_command("PRAGMA user_version = 4;COMMIT;", "apply schema migration 4");
+        }catch(const std::runtime_error &e){
+            clear_statement_cache();
+            sqlite3_exec(DB, "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw;
+        }
+    }
+
+    /** \brief Create the digest table and fill it from the existing tracker entries
+     *
+     * Keyed on (day, entity) without a rowid, so a day range is one ordered walk of the primary key
+     */
+    void migrate_add_digests(){
+        clear_statement_cache(); // Plans may change under a new schema
+        try{
+            run_command("BEGIN;"
+                "CREATE TABLE IF NOT EXISTS digests(day INTEGER, entity_id BLOB, duration INTEGER, PRIMARY KEY(day, entity_id)) WITHOUT ROWID;", "create digests table");
+            rebuild_digests();
+            clear_statement_cache();
+            run_command("PRAGMA user_version = 3;COMMIT;", "apply schema migration 3");
+        }catch(const std::runtime_error &e){
+            clear_statement_cache();
+            sqlite3_exec(DB, "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw;
+        }
+    }
+
+    /** \brief Replace the digest table contents with digests recomputed from every tracker entry
+     *
+     * Memory is one entry per day and entity. Does NOT open a transaction - the caller must
+     */
+    void rebuild_digests(){
+        dailyDigestAccumulator acc;
+        streamTrackerEntries([&acc](const std::vector<timeStamp> & chunk){acc.add(chunk);});
+        run_command("DELETE FROM digests;", "clear digests");
+        for(auto & dg : acc.result()) add_to_digest(dg.day, dg.entityUid, dg.duration);
+    }
+    void add_to_digest(timecode day, const proIds::Uuid & id, timecode duration){
+        const std::string cmd = "INSERT INTO digests VALUES(?, ?, ?) ON CONFLICT(day, entity_id) DO UPDATE SET duration = duration + excluded.duration;";
+        cachedStatement prep_cmd = prepare(cmd);
+        sqlite3_bind_int64(prep_cmd, 1, day);
+        bind_uid(prep_cmd, 2, id);
+        sqlite3_bind_int64(prep_cmd, 3, duration);
+        if(sqlite3_step(prep_cmd) != SQLITE_DONE){
+            std::cerr<< sqlite3_errmsg(DB) << std::endl;
+            throw std::runtime_error("Failed to update digest");
+        }
+    }
+    /** \brief Take time back off a digest, dropping it if that empties it - as a rebuild would not have written it */
+    void remove_from_digest(timecode day, const proIds::Uuid & id, timecode duration){
+        add_to_digest(day, id, -duration);
+        const std::string cmd = "DELETE FROM digests WHERE day = ? AND entity_id = ? AND duration <= 0;";
+        cachedStatement prep_cmd = prepare(cmd);
+        sqlite3_bind_int64(prep_cmd, 1, day);
+        bind_uid(prep_cmd, 2, id);
+        if(sqlite3_step(prep_cmd) != SQLITE_DONE){
+            std::cerr<< sqlite3_errmsg(DB) << std::endl;
+            throw std::runtime_error("Failed to update digest");
+        }
+    }
+    /** \brief Read the latest tracker entry into lastStamp, if not already known. Call BEFORE inserting a new entry */
+    void load_last_stamp(){
+        if(lastStampKnown) return;
+        try{
+            lastStamp = fetchLatestTrackerEntry();
+        }catch(const std::runtime_error &e){
+            lastStamp = {timecodeNull, proIds::NullUid}; // Empty table
+        }
+        lastStampKnown = true;
+    }
+    /** \brief Whether a stamp lands at or before the latest, so splits an interval already credited (or ties the latest) rather than closing the open one */
+    bool splits_interval(const timeStamp & stamp) const{
+        return lastStamp.time != timecodeNull && stamp.time <= lastStamp.time;
+    }
+    /** \brief Bring the digests up to date for a newly inserted stamp
+     *
+     * The stamp closes the interval opened by the previous latest stamp, so that interval is credited, split at midnight. A stamp at or before the latest one (e.g. after time travel) lands inside an already credited interval and splits it: from the stamp to the next entry moves from runningThen - what was in force at its time before it was inserted - to what is in force now. That is the stamp's entity unless an equal-time entry sorts after it. Three index probes and a day or so of digests, however long the history
+     */
+    void update_digests(const timeStamp & stamp, const proIds::Uuid & runningThen){
+        if(splits_interval(stamp)){
+            proIds::Uuid owner = fetchTrackerEntryAt(stamp.time).projectUid;
+            timeStamp next = fetchTrackerEntryAfter(stamp.time);
+            if(next.time == timecodeNull){
+                lastStamp = {stamp.time, owner}; // Tied the latest - nothing closed, but the open interval may change hands
+                return;
+            }
+            if(owner == runningThen) return;
+            if(runningThen != proIds::NullUid){
+                digestDays.splitByDay(stamp.time, next.time, [&](timecode day, timecode secs){remove_from_digest(day, runningThen, secs);});
+            }
+            if(owner != proIds::NullUid){
+                digestDays.splitByDay(stamp.time, next.time, [&](timecode day, timecode secs){add_to_digest(day, owner, secs);});
+            }
+            return;
+        }
+        if(lastStamp.time != timecodeNull && lastStamp.projectUid != proIds::NullUid){
+            digestDays.splitByDay(lastStamp.time, stamp.time, [this](timecode day, timecode secs){add_to_digest(day, lastStamp.projectUid, secs);});
+        }
+        lastStamp = stamp;
+    }
+
+    /** \brief Get the EXPLAIN QUERY PLAN output for a statement, one step per line */
+    std::string explain_query_plan(const std::string & cmd){
+        std::string plan;
+        cachedStatement prep_cmd = prepare("EXPLAIN QUERY PLAN " + cmd);
+        while(sqlite3_step(prep_cmd) == SQLITE_ROW){
+            plan += reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 3));
+            plan += '\n';
+        }
+        return plan;
+    }
     void create_tables(){
         int err = 0;
-        std::string cmd = "CREATE TABLE IF NOT EXISTS projects(id CHAR(36) PRIMARY KEY, name TEXT, FTE REAL, start_date INTEGER, end_date INTEGER);";
+        std::string cmd = "CREATE TABLE IF NOT EXISTS projects(id BLOB PRIMARY KEY, name TEXT, FTE REAL, start_date INTEGER, end_date INTEGER);";
         err = sqlite3_exec(DB, cmd.c_str(), NULL, NULL, &errMsg);
         if(err != SQLITE_OK){
             std::cerr << "Error creating projects table: " << errMsg << std::endl;
             sqlite3_free(errMsg);
             throw std::runtime_error("Failed to create projects table");
         }
-        cmd = "CREATE TABLE IF NOT EXISTS subprojects(id CHAR(36) PRIMARY KEY, name TEXT, frac REAL, parent_id CHAR(36), FOREIGN KEY(parent_id) REFERENCES projects(id));";
+        cmd = "CREATE TABLE IF NOT EXISTS subprojects(id BLOB PRIMARY KEY, name TEXT, frac REAL, parent_id BLOB, FOREIGN KEY(parent_id) REFERENCES projects(id));";
         err = sqlite3_exec(DB, cmd.c_str(), NULL, NULL, &errMsg);
         if(err != SQLITE_OK){
             std::cerr << "Error creating subprojects table: " << errMsg << std::endl;
@@ -64,7 +408,7 @@ class databaseStore{
             throw std::runtime_error("Failed to create subprojects table");
         }
 
-        cmd = "CREATE TABLE IF NOT EXISTS timestamps(id INTEGER PRIMARY KEY, time INTEGER, project_id CHAR(36));";
+        cmd = "CREATE TABLE IF NOT EXISTS timestamps(id INTEGER PRIMARY KEY, time INTEGER, project_id BLOB);";
         err = sqlite3_exec(DB, cmd.c_str(), NULL, NULL, &errMsg);
         if(err != SQLITE_OK){
             std::cerr << "Error creating timestamps table: " << errMsg << std::endl;
@@ -73,7 +417,7 @@ class databaseStore{
         }
 
         // Table for logging names/info about oneoff projects - expect SHORT description
-        cmd = "CREATE TABLE IF NOT EXISTS oneoffs(id CHAR(36) PRIMARY KEY, name TEXT, descr TEXT);";
+        cmd = "CREATE TABLE IF NOT EXISTS oneoffs(id BLOB PRIMARY KEY, name TEXT, descr TEXT);";
         err = sqlite3_exec(DB, cmd.c_str(), NULL, NULL, &errMsg);
         if(err != SQLITE_OK){
             std::cerr << "Error creating oneoffs table: " << errMsg << std::endl;
@@ -92,8 +436,18 @@ class databaseStore{
         // TODO - extended descriptions table - could add all sorts of extra info
     }
 
+    /** \brief Connection-local table of ids, for set-based filtering
+     *
+     * Lives in the temp schema, so is never written to the database file and is not seen by check_tables
+     */
+    void create_temp_tables(){
+        run_command("CREATE TEMP TABLE IF NOT EXISTS parent_filter(id BLOB PRIMARY KEY) WITHOUT ROWID;", "create parent filter table");
+    }
+
     void delete_all_tables(){
-        std::string cmd = "DROP TABLE IF EXISTS subprojects; DROP TABLE IF EXISTS projects; DROP TABLE IF EXISTS oneoffs; DROP TABLE IF EXISTS timestamps; DROP TABLE IF EXISTS app_data;";
+        clear_statement_cache(); // Cached statements refer to the tables
+        lastStampKnown = false;
+        std::string cmd = "DROP TABLE IF EXISTS subprojects; DROP TABLE IF EXISTS projects; DROP TABLE IF EXISTS oneoffs; DROP TABLE IF EXISTS timestamps; DROP TABLE IF EXISTS app_data; DROP TABLE IF EXISTS digests;";
         int err = sqlite3_exec(DB, cmd.c_str(), NULL, NULL, &errMsg);
         if(err != SQLITE_OK){
             std::cerr << "Error deleting tables: " << errMsg << std::endl;
@@ -104,7 +458,7 @@ class databaseStore{
 
     }
     public:
-    databaseStore(std::string fileName) : dbFileName(fileName) {
+    databaseStore(std::string fileName, durabilityConfig dur = durabilityConfig()) : dbFileName(fileName), durability(dur) {
         std::cout<<"Opening Database"<<std::endl; 
         sqlite3_config(SQLITE_CONFIG_SERIALIZED);
         int exit = sqlite3_open((dbFileName).c_str(), &DB); 
@@ -116,28 +470,69 @@ class databaseStore{
 
         // Enable foreign keys
         enable_foreign_keys();
+        apply_durability();
         // Check if tables exist, create if not
 
         bool tables_ready = check_tables(); // Check if tables exist - throws if bad, false if not all present
         if(!tables_ready) create_tables(); // Create the tables if they don't exist but we had no errors
+        // Version 0 databases hold text ids. A freshly created database also reports 0 and goes through every step, on empty tables
+        run_migrations();
+        create_temp_tables();
     }
     ~databaseStore(){
+        try{
+            flush();
+        }catch(const std::runtime_error &e){
+            std::cerr << "Pending tracker entries lost on close: " << e.what() << std::endl;
+        }
+        clear_statement_cache();
         if(DB) sqlite3_close(DB);
     } 
 
+    /** \brief Check the timestamp queries are index-backed
+     *
+     * A plan fails if it scans a table without an index or sorts in a temporary b-tree. Plans on an empty database say little, so run this against a populated one - the bench does
+     * @returns True if all plans pass. Failures are reported on cerr
+     */
+    bool checkQueryPlans(){
+        bool ok = true;
+        for(auto & cmd : {trackerQueries::all, trackerQueries::from, trackerQueries::upTo, trackerQueries::range, trackerQueries::latest, trackerQueries::earliest, trackerQueries::atOrBefore, trackerQueries::after, trackerQueries::digestRange, trackerQueries::subprojectsForParents, trackerQueries::oneOffsInRange}){
+            std::string plan = explain_query_plan(cmd);
+            std::stringstream ss(plan);
+            std::string line;
+            while(std::getline(ss, line)){
+                bool bareScan = line.rfind("SCAN", 0) == 0 && line.find("INDEX") == std::string::npos;
+                if(bareScan || line.find("TEMP B-TREE") != std::string::npos){
+                    std::cerr << "Query not index-backed: " << cmd << "\n" << plan << std::endl;
+                    ok = false;
+                    break;
+                }
+            }
+        }
+        return ok;
+    }
+
+    /** \brief Commit the open group-commit transaction, if any
+     *
+     * @param onlyIfDue Only commit if the batch has reached its size or age limit
+     */
+    void flush(bool onlyIfDue=false){
+        if(pendingWrites == 0) return;
+        if(onlyIfDue && !batchDue()) return;
+        run_command("COMMIT;", "commit tracker entries");
+        pendingWrites = 0;
+    }
+
     void writeProject(const fullProjectData & dat){
 
         //Unpacking
-        const std::string & id = dat.uid.to_string();
         const std::string & name = dat.name;
         const double FTE = dat.FTE;
 
-        std::string cmd;
-        sqlite3_stmt * prep_cmd;
+        const std::string cmd = "insert into projects values(?, ?, ?, ?, ?) ON CONFLICT(id) DO UPDATE SET name=excluded.name, FTE=excluded.FTE, start_date=excluded.start_date, end_date=excluded.end_date;"; // TODO check the conflict clause
+        cachedStatement prep_cmd = prepare(cmd);
         int err = 0;
-        cmd = "insert into projects values(?, ?, ?, ?, ?) ON CONFLICT(id) DO UPDATE SET name=excluded.name, FTE=excluded.FTE, start_date=excluded.start_date, end_date=excluded.end_date;"; // TODO check the conflict clause
-        err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
-        sqlite3_bind_text(prep_cmd, 1, id.c_str(), id.length(), SQLITE_STATIC);
+        bind_uid(prep_cmd, 1, dat.uid);
         sqlite3_bind_text(prep_cmd, 2, name.c_str(), name.length(), SQLITE_STATIC);
         sqlite3_bind_double(prep_cmd, 3, FTE);
         if(dat.useStart){
@@ -157,46 +552,39 @@ class databaseStore{
             std::cerr<< sqlite3_errmsg(DB) << std::endl;
             throw std::runtime_error("Failed to write project");
         }
-        sqlite3_finalize(prep_cmd);
+        flush(); // Do not hold entity changes back in a tracker entry batch
     }
     void writeSubProject(const fullSubProjectData & dat){
 
         //Unpacking
-        const std::string & id = dat.uid.to_string();
         const std::string & name = dat.name;
         const double frac = dat.frac;
-        const std::string & parent_id = dat.parentUid.to_string();
 
-        std::string cmd;
-        sqlite3_stmt * prep_cmd;
+        const std::string cmd = "insert into subprojects values(?, ?, ?, ?) ON CONFLICT(id) DO UPDATE SET name=excluded.name, frac=excluded.frac, parent_id=excluded.parent_id;"; // TODO check the conflict clause
+        cachedStatement prep_cmd = prepare(cmd);
         int err = 0;
-        cmd = "insert into subprojects values(?, ?, ?, ?) ON CONFLICT(id) DO UPDATE SET name=excluded.name, frac=excluded.frac, parent_id=excluded.parent_id;"; // TODO check the conflict clause
-        err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
-        sqlite3_bind_text(prep_cmd, 1, id.c_str(), id.length(), SQLITE_STATIC);
+        bind_uid(prep_cmd, 1, dat.uid);
         sqlite3_bind_text(prep_cmd, 2, name.c_str(), name.length(), SQLITE_STATIC);
         sqlite3_bind_double(prep_cmd, 3, frac);
-        sqlite3_bind_text(prep_cmd, 4, parent_id.c_str(), parent_id.length(), SQLITE_STATIC);
+        bind_uid(prep_cmd, 4, dat.parentUid);
         err = sqlite3_step(prep_cmd);
         if(err == SQLITE_DONE) err = SQLITE_OK;
         if(err != SQLITE_OK){
             std::cerr<< sqlite3_errmsg(DB) << std::endl;
             throw std::runtime_error("Failed to write subproject");
         }
-        sqlite3_finalize(prep_cmd);
+        flush(); // Do not hold entity changes back in a tracker entry batch
     }
     void writeOneOff(const fullOneOffProjectData & dat){
 
         //Unpacking
-        const std::string & id = dat.uid.to_string();
         const std::string & name = dat.name;
         const std::string & descr = dat.description; //TODO - limit length on input?
 
-        std::string cmd;
-        sqlite3_stmt * prep_cmd;
+        const std::string cmd = "insert into oneoffs values(?, ?, ?) ON CONFLICT(id) DO UPDATE SET name=excluded.name, descr=excluded.descr;"; // TODO check the conflict clause
+        cachedStatement prep_cmd = prepare(cmd);
         int err = 0;
-        cmd = "insert into oneoffs values(?, ?, ?) ON CONFLICT(id) DO UPDATE SET name=excluded.name, descr=excluded.descr;"; // TODO check the conflict clause
-        err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
-        sqlite3_bind_text(prep_cmd, 1, id.c_str(), id.length(), SQLITE_STATIC);
+        bind_uid(prep_cmd, 1, dat.uid);
         sqlite3_bind_text(prep_cmd, 2, name.c_str(), name.length(), SQLITE_STATIC);
         sqlite3_bind_text(prep_cmd, 3, descr.c_str(), descr.length(), SQLITE_STATIC);
         err = sqlite3_step(prep_cmd);
@@ -205,34 +593,60 @@ class databaseStore{
             std::cerr<< sqlite3_errmsg(DB) << std::endl;
             throw std::runtime_error("Failed to write oneoff");
         }
-        sqlite3_finalize(prep_cmd);
+        flush(); // Do not hold entity changes back in a tracker entry batch
     }
     void writeTrackerEntry(const timeStamp & stamp){
 
         //Unpacking
         const long time = stamp.time;
-        const std::string & project_id = stamp.projectUid.to_string();
 
-        std::string cmd;
-        sqlite3_stmt * prep_cmd;
-        int err = 0;
-        cmd = "insert into timestamps(time, project_id) values(?, ?)"; // No conflict clause here - if we want to avoid overlaps that is a task for the data model
-        err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
-        sqlite3_bind_int64(prep_cmd, 1, time);
-        sqlite3_bind_text(prep_cmd, 2, project_id.c_str(), project_id.length(), SQLITE_STATIC);
-        err = sqlite3_step(prep_cmd);
-        if(err == SQLITE_DONE) err = SQLITE_OK;
-        if(err != SQLITE_OK){
-            throw std::runtime_error("Failed to write tracker entry");
+        const std::string cmd = "insert into timestamps(time, project_id) values(?, ?)"; // No conflict clause here - if we want to avoid overlaps that is a task for the data model
+        bool openedBatch = false; // If this write opened the batch, a failure must close it again - pendingWrites stays 0, so nothing else would
+        if(batching() && pendingWrites == 0){
+            run_command("BEGIN;", "open tracker entry batch");
+            openedBatch = true;
+            batchOpened = std::chrono::steady_clock::now();
+        }
+        // Stamp and digest go in together. A savepoint nests inside an open batch, and acts as its own transaction outside one
+        try{
+            run_command("SAVEPOINT tracker_entry;", "open tracker entry savepoint");
+        }catch(const std::runtime_error &e){
+            if(openedBatch) sqlite3_exec(DB, "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw;
+        }
+        try{
+            load_last_stamp();
+            proIds::Uuid runningThen = splits_interval(stamp) ? fetchTrackerEntryAt(stamp.time).projectUid : proIds::NullUid; // Before the insert, so not this stamp
+            {
+                cachedStatement prep_cmd = prepare(cmd);
+                int err = 0;
+                sqlite3_bind_int64(prep_cmd, 1, time);
+                bind_uid(prep_cmd, 2, stamp.projectUid);
+                err = sqlite3_step(prep_cmd);
+                if(err == SQLITE_DONE) err = SQLITE_OK;
+                if(err != SQLITE_OK){
+                    throw std::runtime_error("Failed to write tracker entry");
+                }
+            }
+            update_digests(stamp, runningThen);
+        }catch(const std::runtime_error &e){
+            lastStampKnown = false; // Re-read after the rollback
+            // The batch holds nothing but this entry if it was opened here, so roll it all back - leaving it open would make the next BEGIN fail
+            sqlite3_exec(DB, openedBatch ? "ROLLBACK;" : "ROLLBACK TO tracker_entry; RELEASE tracker_entry;", nullptr, nullptr, nullptr);
+            throw;
+        }
+        run_command("RELEASE tracker_entry;", "release tracker entry savepoint");
+        if(batching()){
+            pendingWrites++;
+            flush(true);
         }
-        sqlite3_finalize(prep_cmd);
     }
 
     fullProjectData readProject(proIds::Uuid const & id){
         std::string cmd = "SELECT name, FTE, start_date, end_date FROM projects WHERE id = ?;";
-        sqlite3_stmt * prep_cmd;
-        int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
-        sqlite3_bind_text(prep_cmd, 1, id.to_string().c_str(), id.to_string().length(), SQLITE_STATIC);
+        cachedStatement prep_cmd = prepare(cmd);
+        int err = SQLITE_OK;
+        bind_uid(prep_cmd, 1, id);
         
         fullProjectData ret;
         timecode tmp;
@@ -260,18 +674,17 @@ class databaseStore{
         }else{
             throw std::runtime_error("Failed to read project");
         }
-        sqlite3_finalize(prep_cmd);
         return ret;
     }
     std::vector<fullProjectData> fetchProjectList(){
         std::string cmd = "SELECT id, name, FTE, start_date, end_date FROM projects ORDER by name;";
-        sqlite3_stmt * prep_cmd;
-        int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
+        cachedStatement prep_cmd = prepare(cmd);
+        int err = SQLITE_OK;
         
         std::vector<fullProjectData> ret;
         while((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
             fullProjectData proj;
-            proj.uid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 0)));
+            proj.uid = column_uid(prep_cmd, 0);
             proj.name = reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 1));
             proj.FTE = sqlite3_column_double(prep_cmd, 2);
             timecode tmp = sqlite3_column_int64(prep_cmd, 3);
@@ -296,16 +709,15 @@ class databaseStore{
         if(err != SQLITE_DONE){
             throw std::runtime_error("Failed to fetch project list");
         }
-        sqlite3_finalize(prep_cmd);
         return ret;
     }
     std::vector<fullProjectData> fetchProjectListActiveAt(timecode date){
         // date should NOT be null- it will be used
 
         // Assuming for now that '0' is the null date
-        std::string cmd = "SELECT id, name, FTE, start_date, end_date FROM projects WHERE (start_date <= {} or start_date == {}) AND (end_date >= {} OR end_date == {}) ORDER by name;";
-        sqlite3_stmt * prep_cmd;
-        int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
+        std::string cmd = "SELECT id, name, FTE, start_date, end_date FROM projects WHERE (start_date <= ? or start_date == ?) AND (end_date >= ? OR end_date == ?) ORDER by name;";
+        cachedStatement prep_cmd = prepare(cmd);
+        int err = SQLITE_OK;
         sqlite3_bind_int64(prep_cmd, 1, date);
         sqlite3_bind_int64(prep_cmd, 2, 0); //TODO - use null value not plain 0
         sqlite3_bind_int64(prep_cmd, 3, date);
@@ -314,7 +726,7 @@ class databaseStore{
         std::vector<fullProjectData> ret;
         while((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
             fullProjectData proj;
-            proj.uid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 0)));
+            proj.uid = column_uid(prep_cmd, 0);
             proj.name = reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 1));
             proj.FTE = sqlite3_column_double(prep_cmd, 2);
             timecode tmp = sqlite3_column_int64(prep_cmd, 3);
@@ -339,94 +751,89 @@ class databaseStore{
         if(err != SQLITE_DONE){
             throw std::runtime_error("Failed to fetch project list");
         }
-        sqlite3_finalize(prep_cmd);
         return ret;
     }
 
     fullSubProjectData readSubproject(proIds::Uuid const & id){
         std::string cmd = "SELECT name, frac, parent_id FROM subprojects WHERE id = ?;";
-        sqlite3_stmt * prep_cmd;
-        int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
-        sqlite3_bind_text(prep_cmd, 1, id.to_string().c_str(), id.to_string().length(), SQLITE_STATIC);
+        cachedStatement prep_cmd = prepare(cmd);
+        int err = SQLITE_OK;
+        bind_uid(prep_cmd, 1, id);
         
         fullSubProjectData ret;
         if((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
             ret.uid = id;
             ret.name = reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 0));
             ret.frac = sqlite3_column_double(prep_cmd, 1);
-            ret.parentUid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 2)));
+            ret.parentUid = column_uid(prep_cmd, 2);
         }else{
             throw std::runtime_error("Failed to read subproject");
         }
-        sqlite3_finalize(prep_cmd);
         return ret;
     }
     std::vector<fullSubProjectData> fetchSubprojectList(){
         std::string cmd = "SELECT id, name, frac, parent_id FROM subprojects ORDER by parent_id, name;";
-        sqlite3_stmt * prep_cmd;
-        int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
+        cachedStatement prep_cmd = prepare(cmd);
+        int err = SQLITE_OK;
         std::vector<fullSubProjectData> ret;
         while((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
             fullSubProjectData subproj;
-            subproj.uid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 0)));
+            subproj.uid = column_uid(prep_cmd, 0);
             subproj.uid.tag(proIds::uidTag::sub);
             subproj.name = reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 1));
             subproj.frac = sqlite3_column_double(prep_cmd, 2);
-            subproj.parentUid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 3)));
+            subproj.parentUid = column_uid(prep_cmd, 3);
             ret.push_back(subproj);
         }
         if(err != SQLITE_DONE){
             throw std::runtime_error("Failed to fetch subproject list");
         }
-        sqlite3_finalize(prep_cmd);
         return ret;
     }
     std::vector<fullSubProjectData> fetchSubprojectListForParents(std::vector<proIds::Uuid> ids){
-        //In general the list should be short, so filter on the client side. If list can be large, consider
-        // filtering after fetch to avoid unwieldy query.
-        std::string cmd = "SELECT id, name, frac, parent_id FROM subprojects WHERE";
-        std::string order_clause = "ORDER by parent_id, name;";
-        sqlite3_stmt * prep_cmd;
-
-        // Create a suitable COUNT of ids subclauses with '?' placeholder
-        std::stringstream ss;
-        for(int i = 0; i<ids.size()-1 ; i++) ss<<" parent_id == ? OR";
-        if(ids.size() > 0) ss<<" parent_id == ? "; // Last one has no 'OR' - if only one supplied, only this clause applies
-
-        // Patch together complete command
-        cmd = cmd + ss.str() + order_clause;
-        int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
-
-        //Bind the actual ids
-        for(int i = 0; i < ids.size(); i++){
-            std::string id = ids[i].to_string();
-            sqlite3_bind_text(prep_cmd, i+1, id.c_str(), id.length(), SQLITE_TRANSIENT); // id string has scope of loop iteration, so use TRANSIENT to prolong
-        }
-
+        // The ids go into a temp table and are joined against the parent index, so the SQL is the same for any count and is planned once
         std::vector<fullSubProjectData> ret;
-        while((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
-            fullSubProjectData subproj;
-            subproj.uid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 0)));
-            subproj.uid.tag(proIds::uidTag::sub);
-            subproj.name = reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 1));
-            subproj.frac = sqlite3_column_double(prep_cmd, 2);
-            subproj.parentUid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 3)));
-            ret.push_back(subproj);
-        }
-        if(err != SQLITE_DONE){
-            throw std::runtime_error("Failed to fetch subproject list");
+        if(ids.size() == 0) return ret;
+
+        run_command("SAVEPOINT parent_filter;", "open parent filter savepoint"); // One transaction for all the id inserts, nests inside a write batch
+        try{
+            run_command("DELETE FROM temp.parent_filter;", "clear parent filter");
+            {
+                cachedStatement prep_insert = prepare("INSERT OR IGNORE INTO temp.parent_filter VALUES(?);"); // Duplicates would repeat rows
+                for(auto & id : ids){
+                    bind_uid(prep_insert, 1, id);
+                    if(sqlite3_step(prep_insert) != SQLITE_DONE) throw std::runtime_error("Failed to fill parent filter");
+                    sqlite3_reset(prep_insert);
+                }
+            }
+            cachedStatement prep_cmd = prepare(trackerQueries::subprojectsForParents);
+            int err = SQLITE_OK;
+            while((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
+                fullSubProjectData subproj;
+                subproj.uid = column_uid(prep_cmd, 0);
+                subproj.uid.tag(proIds::uidTag::sub);
+                subproj.name = reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 1));
+                subproj.frac = sqlite3_column_double(prep_cmd, 2);
+                subproj.parentUid = column_uid(prep_cmd, 3);
+                ret.push_back(subproj);
+            }
+            if(err != SQLITE_DONE){
+                throw std::runtime_error("Failed to fetch subproject list");
+            }
+        }catch(const std::runtime_error &e){
+            sqlite3_exec(DB, "ROLLBACK TO parent_filter; RELEASE parent_filter;", nullptr, nullptr, nullptr);
+            throw;
         }
-        sqlite3_finalize(prep_cmd);
+        run_command("RELEASE parent_filter;", "release parent filter savepoint");
         return ret;
-
     }
 
     fullOneOffProjectData readOneOff(proIds::Uuid const & id){
         
         std::string cmd = "SELECT name, descr FROM oneoffs WHERE id = ?;";
-        sqlite3_stmt * prep_cmd;
-        int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
-        sqlite3_bind_text(prep_cmd, 1, id.to_string().c_str(), id.to_string().length(), SQLITE_STATIC);
+        cachedStatement prep_cmd = prepare(cmd);
+        int err = SQLITE_OK;
+        bind_uid(prep_cmd, 1, id);
         
         fullOneOffProjectData ret;
         if((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
@@ -436,17 +843,16 @@ class databaseStore{
         }else{
             throw std::runtime_error("Failed to read one off");
         }
-        sqlite3_finalize(prep_cmd);
         return ret; 
     }
     std::vector<fullOneOffProjectData> fetchOneOffList(){
         std::string cmd = "SELECT id, name, descr FROM oneoffs ORDER by name;";
-        sqlite3_stmt * prep_cmd;
-        int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
+        cachedStatement prep_cmd = prepare(cmd);
+        int err = SQLITE_OK;
         std::vector<fullOneOffProjectData> ret;
         while((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
             fullOneOffProjectData proj;
-            proj.uid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 0)));
+            proj.uid = column_uid(prep_cmd, 0);
             proj.uid.tag(proIds::uidTag::oneoff);
             proj.name = reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 1));
             proj.description = reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 2));
@@ -455,20 +861,19 @@ class databaseStore{
         if(err != SQLITE_DONE){
             throw std::runtime_error("Failed to fetch one-offs list");
         }
-        sqlite3_finalize(prep_cmd);
         return ret;
     }
     std::vector<fullOneOffProjectData> fetchOneOffsInRange(timecode start, timecode end){
-        std::string cmd =  "SELECT ts.time, oo.id, oo.name, oo.descr FROM timestamps AS ts INNER JOIN oneoffs AS oo ON ts.project_id = oo.id WHERE ts.time > ? and ts.time < ?;";
-        sqlite3_stmt * prep_cmd;
-        int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
+        const std::string & cmd = trackerQueries::oneOffsInRange;
+        cachedStatement prep_cmd = prepare(cmd);
+        int err = SQLITE_OK;
         sqlite3_bind_int64(prep_cmd, 1, start);
         sqlite3_bind_int64(prep_cmd, 2, end);
 
         std::vector<fullOneOffProjectData> ret;
         while((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
             fullOneOffProjectData proj;
-            proj.uid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 1)));
+            proj.uid = column_uid(prep_cmd, 1);
             proj.uid.tag(proIds::uidTag::oneoff);
             proj.name = reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 2));
             proj.description = reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 3));
@@ -477,56 +882,136 @@ class databaseStore{
         if(err != SQLITE_DONE){
             throw std::runtime_error("Failed to fetch one-offs list");
         }
-        sqlite3_finalize(prep_cmd);
         return ret; 
 
     }
 
     std::vector<timeStamp> fetchTrackerEntries(timecode start=-1, timecode end=-1){
         //TODO - should the Uid tags be handled down here?
-      //TODO - is there an elegant way to do this with prepared statements?
-      std::string where_clause ="";
-      if(start != -1){
-        where_clause += "t.time >="+std::to_string(start);
+      std::vector<timeStamp> ret;
+      streamTrackerEntries([&ret](const std::vector<timeStamp> & chunk){ret.insert(ret.end(), chunk.begin(), chunk.end());}, start, end);
+      return ret;
+    }
+
+    /** \brief Walk tracker entries in time order without materialising the whole range
+     *
+     * Steps the live statement and hands entries to sink in chunks of at most chunkSize, so memory is bounded by the chunk. The sink must not fetch tracker entries from this store itself - the statement is in use until this returns
+     */
+    void streamTrackerEntries(const timeStampChunkSink & sink, timecode start=-1, timecode end=-1, size_t chunkSize=stampChunkSize){
+      // One fixed query per combination of bounds, so each can be cached and the bounds bound rather than spliced in
+      std::string cmd;
+      if(start != -1 && end != -1){
+        cmd = trackerQueries::range;
+      }else if(start != -1){
+        cmd = trackerQueries::from;
+      }else if(end != -1){
+        cmd = trackerQueries::upTo;
+      }else{
+        cmd = trackerQueries::all;
       }
-      if(end != -1){
-        if(where_clause != "") where_clause += " AND ";
-        where_clause += "t.time <="+std::to_string(end);
+      cachedStatement prep_cmd = prepare(cmd);
+      if(start != -1) sqlite3_bind_int64(prep_cmd, 1, start);
+      if(end != -1) sqlite3_bind_int64(prep_cmd, 2, end);
+      int err = SQLITE_OK;
+      std::vector<timeStamp> chunk;
+      chunk.reserve(chunkSize);
+      while((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
+        chunk.push_back({sqlite3_column_int64(prep_cmd, 0), column_uid(prep_cmd, 1)});
+        if(chunk.size() >= chunkSize){
+          sink(chunk);
+          chunk.clear();
+        }
       }
-      if(where_clause != ""){
-        where_clause = " WHERE " + where_clause + " ";
+      if(err != SQLITE_DONE){
+        throw std::runtime_error("Failed to fetch tracker entries");
       }
-      std::string order_clause = "ORDER BY time";
-      std::string cmd = "SELECT time, project_id from timestamps t "+where_clause + order_clause + ';';
-      std::cout<<cmd<<std::endl;
-      sqlite3_stmt * prep_cmd;
-      int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr); 
-      std::vector<timeStamp> ret;
-      while((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
-            timeStamp stamp;
-            stamp.time = sqlite3_column_int64(prep_cmd, 0);
-            stamp.projectUid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 1)));
-            ret.push_back(stamp);
+      if(chunk.size() > 0) sink(chunk);
+    }
+
+    /** \brief Recompute every digest from the tracker entries
+     *
+     * For databases whose digests are missing or suspect. Runs in one transaction
+     */
+    void rebuildDailyDigests(){
+        flush();
+        run_command("BEGIN;", "open digest rebuild");
+        try{
+            rebuild_digests();
+        }catch(const std::runtime_error &e){
+            sqlite3_exec(DB, "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw;
+        }
+        run_command("COMMIT;", "commit digest rebuild");
+    }
+
+    /** \brief Fetch digests for days starting within [start, end], ordered by day. -1 for no bound */
+    std::vector<dailyDigest> fetchDailyDigests(timecode start=-1, timecode end=-1){
+        cachedStatement prep_cmd = prepare(trackerQueries::digestRange);
+        sqlite3_bind_int64(prep_cmd, 1, start != -1 ? start : LLONG_MIN);
+        sqlite3_bind_int64(prep_cmd, 2, end != -1 ? end : LLONG_MAX);
+        int err = SQLITE_OK;
+        std::vector<dailyDigest> ret;
+        while((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
+            ret.push_back({sqlite3_column_int64(prep_cmd, 0), column_uid(prep_cmd, 1), sqlite3_column_int64(prep_cmd, 2)});
         }
         if(err != SQLITE_DONE){
-            throw std::runtime_error("Failed to fetch tracker entries");
+            throw std::runtime_error("Failed to fetch digests");
+        }
+        return ret;
+    }
+
+    timeStamp fetchEarliestTrackerEntry(){
+        const std::string & cmd = trackerQueries::earliest;
+        cachedStatement prep_cmd = prepare(cmd);
+        timeStamp ret;
+        if(sqlite3_step(prep_cmd) == SQLITE_ROW){
+            ret.time = sqlite3_column_int64(prep_cmd, 0);
+            ret.projectUid = column_uid(prep_cmd, 1);
+        }else{
+            throw std::runtime_error("Failed to read timestamp");
+        }
+        return ret;
+    }
+
+    /** \brief The entry in force at time - the latest at or before it. One index probe
+     *
+     * @returns The entry, or {timecodeNull, NullUid} if there is none that early
+     */
+    timeStamp fetchTrackerEntryAt(timecode time){
+        const std::string & cmd = trackerQueries::atOrBefore;
+        cachedStatement prep_cmd = prepare(cmd);
+        sqlite3_bind_int64(prep_cmd, 1, time);
+        timeStamp ret{timecodeNull, proIds::NullUid};
+        if(sqlite3_step(prep_cmd) == SQLITE_ROW){
+            ret.time = sqlite3_column_int64(prep_cmd, 0);
+            ret.projectUid = column_uid(prep_cmd, 1);
+        }
+        return ret;
+    }
+
+    /** \brief The first entry after time - strictly after. {timecodeNull, NullUid} if there is none. One index probe */
+    timeStamp fetchTrackerEntryAfter(timecode time){
+        cachedStatement prep_cmd = prepare(trackerQueries::after);
+        sqlite3_bind_int64(prep_cmd, 1, time);
+        timeStamp ret{timecodeNull, proIds::NullUid};
+        if(sqlite3_step(prep_cmd) == SQLITE_ROW){
+            ret.time = sqlite3_column_int64(prep_cmd, 0);
+            ret.projectUid = column_uid(prep_cmd, 1);
         }
-        sqlite3_finalize(prep_cmd);
         return ret;
     }
 
     timeStamp fetchLatestTrackerEntry(){
-        std::string cmd = "SELECT time, project_id from timestamps t ORDER BY time DESC LIMIT 1;";
-        sqlite3_stmt * prep_cmd;
-        int err = sqlite3_prepare_v2(DB, cmd.c_str(), cmd.length(), &prep_cmd, nullptr);
+        const std::string & cmd = trackerQueries::latest;
+        cachedStatement prep_cmd = prepare(cmd);
+        int err = SQLITE_OK;
         timeStamp ret;
         if((err = sqlite3_step(prep_cmd)) == SQLITE_ROW){
             ret.time = sqlite3_column_int64(prep_cmd, 0);
-            ret.projectUid = proIds::Uuid(reinterpret_cast<const char *>(sqlite3_column_text(prep_cmd, 1)));
+            ret.projectUid = column_uid(prep_cmd, 1);
         }else{
             throw std::runtime_error("Failed to read timestamp");
         }
-        sqlite3_finalize(prep_cmd);
         return ret;
     }
 };
@@ -0,0 +1,97 @@
+#ifndef ____durationIndex_h__
+#define ____durationIndex_h__
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "idGenerators.h"
+#include "dataObjects.h"
+
+/**
+ * @brief Prefix sums of tracked time per entity, for range queries in O(log n)
+ *
+ * For each entity, keeps the intervals credited to it in time order, each with the entity's total before it. Time on an entity up to any t is then one binary search, and time between t0 and t1 is the difference of two.
+ * Built once from the full stamp list, then extended a stamp at a time - a new stamp closes the running interval and opens the next. The last interval stays open, running up to whatever time is asked about, so query no later than now. Stamps must arrive in time order - add reports one that does not, and the owner should rebuild.
+ * Crediting is as stampsToDurations: each interval goes to the stamp which opened it. Untracked (NullUid) time is not indexed. Memory is one entry per stamp
+ */
+class durationIndex{
+
+    /** \brief One interval credited to an entity */
+    struct span{
+      timecode start;
+      timecode end; /**< \brief timecodeNull while still open */
+      timecode before; /**< \brief Entity's total over all earlier spans */
+    };
+
+    proIds::uidInterner ids;
+    std::vector<std::vector<span>> spans; /**< \brief Per dense id, ordered on start */
+    timecode lastTime = timecodeNull; /**< \brief Time of the latest stamp */
+    proIds::denseId running = proIds::nullDenseId; /**< \brief Entity holding the open span */
+
+    /** \brief Time credited to entity id before t */
+    timecode cumulativeAt(proIds::denseId id, timecode t) const{
+      if(id >= spans.size()) return 0;
+      auto & list = spans[id];
+      auto it = std::upper_bound(list.begin(), list.end(), t, [](timecode v, const span & s){return v < s.start;});
+      if(it == list.begin()) return 0;
+      --it; // Last span starting at or before t
+      timecode stop = (it->end == timecodeNull || t < it->end) ? t : it->end;
+      return it->before + (stop - it->start);
+    }
+
+  public:
+    void clear(){
+      ids = proIds::uidInterner();
+      spans.clear();
+      lastTime = timecodeNull;
+      running = proIds::nullDenseId;
+    }
+    /** \brief Replace the index with one for data, which must be in time order */
+    void build(const std::vector<timeStamp> & data){
+      clear();
+      for(auto & stamp : data) add(stamp);
+    }
+
+    /** \brief Extend with a new stamp
+     *
+     * @returns False if the stamp is older than the latest one, in which case nothing is changed
+     */
+    bool add(const timeStamp & stamp){
+      if(lastTime != timecodeNull){
+        if(stamp.time < lastTime) return false;
+        if(running != proIds::nullDenseId) spans[running].back().end = stamp.time;
+      }
+      lastTime = stamp.time;
+      running = ids.intern(stamp.projectUid);
+      if(running != proIds::nullDenseId){
+        if(running >= spans.size()) spans.resize(ids.size());
+        auto & list = spans[running];
+        timecode before = list.empty() ? 0 : list.back().before + (list.back().end - list.back().start);
+        list.push_back({stamp.time, timecodeNull, before});
+      }
+      return true;
+    }
+
+    bool empty() const{return lastTime == timecodeNull;}
+
+    /** \brief Time on one entity within [start, end) */
+    timecode durationBetween(const proIds::Uuid & uid, timecode start, timecode end) const{
+      if(end <= start) return 0;
+      auto id = ids.find(uid);
+      if(id == proIds::nullDenseId) return 0; // Unknown, or untracked time
+      return cumulativeAt(id, end) - cumulativeAt(id, start);
+    }
+    /** \brief Time on every entity with any in [start, end). Costs two binary searches per entity */
+    std::map<proIds::Uuid, timecode> durationsBetween(timecode start, timecode end) const{
+      std::map<proIds::Uuid, timecode> ret;
+      if(end <= start) return ret;
+      for(proIds::denseId id = 1; id < spans.size(); id++){
+        timecode secs = cumulativeAt(id, end) - cumulativeAt(id, start);
+        if(secs > 0) ret[ids.uid(id)] = secs;
+      }
+      return ret;
+    }
+};
+
+#endif
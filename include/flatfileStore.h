@@ -0,0 +1,621 @@
+#ifndef FLATFILESTORE_H
+#define FLATFILESTORE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dataObjects.h"
+#include "idGenerators.h"
+#include "memoryStore.h"
+#include "timestampProcessor.h"
+
+/** \brief CRC-32 (IEEE, as zlib) of a byte range. Used to detect torn records at the tail of the flat files */
+inline uint32_t flatfileChecksum(const void * data, size_t length, uint32_t crc = 0){
+    static const std::vector<uint32_t> table = []{
+        std::vector<uint32_t> t(256);
+        for(uint32_t i = 0; i < 256; i++){
+            uint32_t c = i;
+            for(int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+    for(size_t i = 0; i < length; i++) crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/** \brief On-disk layout of the flat files. Native byte order - the files are not meant to move between machines */
+namespace flatfileFormat{
+    const uint32_t version = 1;
+    const char stampMagic[8] = {'T','T','T','S','T','M','P','\0'};
+    const char entityMagic[8] = {'T','T','T','E','N','T','S','\0'};
+    const char lateMagic[8] = {'T','T','T','L','A','T','E','\0'};
+
+    struct fileHeader{
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize; /**< \brief Size of one stamp record, 0 for the entity file */
+    };
+    /** \brief One tracker entry. Fixed size, so the mapped log is an array which can be binary searched on time */
+    struct stampRecord{
+        int64_t time;
+        unsigned char uid[16]; /**< \brief RFC 4122 bytes, as uidWrapper::to_bytes */
+        uint32_t reserved = 0;
+        uint32_t crc; /**< \brief Checksum of everything above */
+    };
+    static_assert(sizeof(fileHeader) == 16, "Flat file header must be 16 bytes");
+    static_assert(sizeof(stampRecord) == 32, "Stamp record must be 32 bytes");
+
+    enum class entityType : uint8_t{project = 1, subproject = 2, oneoff = 3};
+}
+
+/**
+ * @brief Append-only flat file store
+ *
+ * Three files, all named from the base name given:
+ * - name.stamps holds tracker entries as fixed-size records in time order, read through mmap so range fetches are binary searches over the mapping
+ * - name.late holds stamps older than the latest when written (after time travel), in the same record format but in the order written. It is small, so is read fully on open and held sorted in memory
+ * - name.entities holds projects, subprojects and one-offs as checksummed variable-length records. It is small, so is read fully on open. A later record for the same id replaces an earlier one
+ *
+ * Every record carries a checksum. On open, a partial or corrupt record at the tail (a torn append) is cut off, so a crash loses at most the writes since the last sync.
+ * Sync follows the durability settings: off never syncs, normal syncs on an explicit flush, full syncs each group-commit batch. Late stamps, like entity records, are synced as written.
+ * Reads merge the log with the late stamps, a late one coming after log entries at the same time. Once the late stamps reach a fraction of the log they are merged into it by rewriting it and renaming it into place, so each costs a bounded share of a rewrite rather than a whole one.
+ * Daily digests are computed from the stamps on request rather than stored
+ */
+class flatfileStore{
+
+    std::string stampFileName, entityFileName, lateFileName;
+    durabilityConfig durability;
+    int stampFd = -1, entityFd = -1, lateFd = -1;
+    const flatfileFormat::stampRecord * records = nullptr; /**< \brief Mapped stamp records, first after the header */
+    void * mapping = nullptr;
+    size_t mappedBytes = 0; /**< \brief Length of the mapping, header included */
+    size_t stampCount = 0; /**< \brief Records in the file, mapped or not */
+    int pendingSyncs = 0; /**< \brief Appends since the last sync */
+    std::chrono::steady_clock::time_point batchOpened; /**< \brief When the first unsynced append was made */
+    std::vector<timeStamp> late; /**< \brief Stamps in the late file, in time order, ties in the order written */
+    size_t lateRecords = 0; /**< \brief Records in the late file - the same stamps as late */
+
+    entityStore entities; /**< \brief Everything in the entity file, replayed on open */
+
+    static size_t stampOffset(size_t index){return sizeof(flatfileFormat::fileHeader) + index * sizeof(flatfileFormat::stampRecord);}
+
+    static flatfileFormat::stampRecord pack(const timeStamp & stamp){
+        flatfileFormat::stampRecord rec;
+        rec.time = stamp.time;
+        QByteArray bytes = stamp.projectUid.to_bytes();
+        std::memcpy(rec.uid, bytes.constData(), sizeof(rec.uid));
+        rec.crc = flatfileChecksum(&rec, offsetof(flatfileFormat::stampRecord, crc));
+        return rec;
+    }
+    static timeStamp unpack(const flatfileFormat::stampRecord & rec){
+        return {rec.time, proIds::Uuid(rec.uid, sizeof(rec.uid))};
+    }
+    static bool valid(const flatfileFormat::stampRecord & rec){
+        return rec.crc == flatfileChecksum(&rec, offsetof(flatfileFormat::stampRecord, crc));
+    }
+
+    static void sync_fd(int fd){
+#ifdef __APPLE__
+        if(fsync(fd) != 0) throw std::runtime_error("Failed to sync flat file");
+#else
+        if(fdatasync(fd) != 0) throw std::runtime_error("Failed to sync flat file");
+#endif
+    }
+    static void write_all(int fd, const void * data, size_t length, off_t offset){
+        const char * bytes = static_cast<const char *>(data);
+        while(length > 0){
+            ssize_t done = pwrite(fd, bytes, length, offset);
+            if(done < 0) throw std::runtime_error("Failed to write flat file");
+            bytes += done;
+            length -= done;
+            offset += done;
+        }
+    }
+    /** \brief Sync the directory holding the stamp log, so a rename into it is durable */
+    void sync_directory(){
+        size_t slash = stampFileName.find_last_of('/');
+        std::string dir = slash == std::string::npos ? "." : stampFileName.substr(0, slash + 1);
+        int fd = ::open(dir.c_str(), O_RDONLY);
+        if(fd < 0) return; // Best effort - the rename itself is atomic
+        fsync(fd);
+        close(fd);
+    }
+    static size_t file_size(int fd){
+        struct stat st;
+        if(fstat(fd, &st) != 0) throw std::runtime_error("Failed to stat flat file");
+        return st.st_size;
+    }
+
+    /** \brief Open a file, writing the header if new and checking it if not */
+    static int open_file(const std::string & name, const char * magic, uint32_t recordSize){
+        int fd = ::open(name.c_str(), O_RDWR | O_CREAT, 0644);
+        if(fd < 0){
+            std::cerr << "Error opening flat file: " << name << std::endl;
+            throw std::runtime_error("Failed to open flat file");
+        }
+        flatfileFormat::fileHeader header;
+        if(file_size(fd) < sizeof(header)){
+            std::memcpy(header.magic, magic, sizeof(header.magic));
+            header.version = flatfileFormat::version;
+            header.recordSize = recordSize;
+            if(ftruncate(fd, 0) != 0) throw std::runtime_error("Failed to initialise flat file");
+            write_all(fd, &header, sizeof(header), 0);
+            sync_fd(fd);
+            return fd;
+        }
+        if(pread(fd, &header, sizeof(header), 0) != sizeof(header) || std::memcmp(header.magic, magic, sizeof(header.magic)) != 0){
+            close(fd);
+            std::cerr << "Not a Time Tracker flat file: " << name << std::endl;
+            throw std::runtime_error("Bad flat file header");
+        }
+        if(header.version > flatfileFormat::version || header.recordSize != recordSize){
+            close(fd);
+            std::cerr << "Flat file version " << header.version << " is not supported: " << name << std::endl;
+            throw std::runtime_error("Flat file was written by a newer version");
+        }
+        return fd;
+    }
+
+    /** \brief Map every record in the stamp file. Called after anything changes its length */
+    void remap(){
+        if(mapping) munmap(mapping, mappedBytes);
+        mapping = nullptr;
+        records = nullptr;
+        mappedBytes = stampOffset(stampCount);
+        if(stampCount == 0) return;
+        mapping = mmap(nullptr, mappedBytes, PROT_READ, MAP_SHARED, stampFd, 0);
+        if(mapping == MAP_FAILED){
+            mapping = nullptr;
+            throw std::runtime_error("Failed to map stamp file");
+        }
+        records = reinterpret_cast<const flatfileFormat::stampRecord *>(static_cast<const char *>(mapping) + sizeof(flatfileFormat::fileHeader));
+    }
+    /** \brief Remap if appends have run past the mapping */
+    void ensure_mapped(){
+        if(stampOffset(stampCount) != mappedBytes) remap();
+    }
+
+    /** \brief Cut the stamp log back to its last whole, valid record
+     *
+     * Only the tail can be torn, so checking stops at the first good record from the end
+     */
+    void recover_stamp_tail(){
+        size_t bytes = file_size(stampFd);
+        stampCount = (bytes - sizeof(flatfileFormat::fileHeader)) / sizeof(flatfileFormat::stampRecord);
+        flatfileFormat::stampRecord rec;
+        while(stampCount > 0){
+            if(pread(stampFd, &rec, sizeof(rec), stampOffset(stampCount - 1)) == sizeof(rec) && valid(rec)) break;
+            stampCount--;
+        }
+        if(stampOffset(stampCount) != bytes){
+            std::cerr << "Discarding " << bytes - stampOffset(stampCount) << " bytes of incomplete tracker entries" << std::endl;
+            if(ftruncate(stampFd, stampOffset(stampCount)) != 0) throw std::runtime_error("Failed to truncate stamp file");
+            sync_fd(stampFd);
+        }
+    }
+
+    // Entity records: uint32 payload length, payload, uint32 checksum of payload. Payload starts with the type byte
+    static void put_bytes(std::string & out, const void * data, size_t length){out.append(static_cast<const char *>(data), length);}
+    template<typename T> static void put(std::string & out, T value){put_bytes(out, &value, sizeof(value));}
+    static void putString(std::string & out, const std::string & value){put<uint32_t>(out, value.size()); out += value;}
+    static void putUid(std::string & out, const proIds::Uuid & id){QByteArray bytes = id.to_bytes(); put_bytes(out, bytes.constData(), 16);}
+
+    /** \brief Reads fields back from an entity payload. Throws if the payload is too short */
+    struct payloadReader{
+        const std::string & data;
+        size_t pos = 0;
+        void need(size_t n){if(pos + n > data.size()) throw std::runtime_error("Truncated entity record");}
+        template<typename T> T get(){T value; need(sizeof(T)); std::memcpy(&value, data.data() + pos, sizeof(T)); pos += sizeof(T); return value;}
+        std::string getString(){uint32_t n = get<uint32_t>(); need(n); std::string s = data.substr(pos, n); pos += n; return s;}
+        proIds::Uuid getUid(){need(16); proIds::Uuid id(data.data() + pos, 16); pos += 16; return id;}
+    };
+
+    void apply_entity(const std::string & payload){
+        payloadReader in{payload};
+        auto type = static_cast<flatfileFormat::entityType>(in.get<uint8_t>());
+        if(type == flatfileFormat::entityType::project){
+            fullProjectData dat;
+            dat.uid = in.getUid();
+            dat.name = in.getString();
+            dat.FTE = in.get<double>();
+            dat.start = in.get<int64_t>();
+            dat.end = in.get<int64_t>();
+            uint8_t flags = in.get<uint8_t>();
+            dat.useStart = flags & 1;
+            dat.useEnd = flags & 2;
+            entities.writeProject(dat);
+        }else if(type == flatfileFormat::entityType::subproject){
+            fullSubProjectData dat;
+            dat.uid = in.getUid();
+            dat.name = in.getString();
+            dat.frac = in.get<double>();
+            dat.parentUid = in.getUid();
+            entities.writeSubProject(dat);
+        }else if(type == flatfileFormat::entityType::oneoff){
+            fullOneOffProjectData dat;
+            dat.uid = in.getUid();
+            dat.name = in.getString();
+            dat.description = in.getString();
+            entities.writeOneOff(dat);
+        }else{
+            throw std::runtime_error("Unknown entity record type");
+        }
+    }
+
+    /** \brief Read every entity record, cutting the file at the first partial or corrupt one */
+    void load_entities(){
+        size_t bytes = file_size(entityFd);
+        std::string contents(bytes - sizeof(flatfileFormat::fileHeader), '\0');
+        if(contents.size() > 0 && pread(entityFd, &contents[0], contents.size(), sizeof(flatfileFormat::fileHeader)) != (ssize_t)contents.size()){
+            throw std::runtime_error("Failed to read entity file");
+        }
+        size_t pos = 0;
+        while(pos + sizeof(uint32_t) <= contents.size()){
+            uint32_t length, crc;
+            std::memcpy(&length, contents.data() + pos, sizeof(length));
+            if(pos + sizeof(length) + length + sizeof(crc) > contents.size()) break;
+            std::string payload = contents.substr(pos + sizeof(length), length);
+            std::memcpy(&crc, contents.data() + pos + sizeof(length) + length, sizeof(crc));
+            if(crc != flatfileChecksum(payload.data(), payload.size())) break;
+            apply_entity(payload);
+            pos += sizeof(length) + length + sizeof(crc);
+        }
+        if(pos != contents.size()){
+            std::cerr << "Discarding " << contents.size() - pos << " bytes of incomplete project records" << std::endl;
+            if(ftruncate(entityFd, sizeof(flatfileFormat::fileHeader) + pos) != 0) throw std::runtime_error("Failed to truncate entity file");
+            sync_fd(entityFd);
+        }
+    }
+    void append_entity(const std::string & payload){
+        std::string record;
+        put<uint32_t>(record, payload.size());
+        record += payload;
+        put<uint32_t>(record, flatfileChecksum(payload.data(), payload.size()));
+        write_all(entityFd, record.data(), record.size(), file_size(entityFd));
+        if(durability.sync != syncLevel::off) sync_fd(entityFd); // Entity changes are rare, so always durable
+        apply_entity(payload);
+    }
+
+    /** \brief Late stamps to hold before merging them into the log - a share of the log, so a merge is paid for by many late writes */
+    size_t late_limit() const{return std::max<size_t>(1024, stampCount / 8);}
+
+    /** \brief Read the late file, cutting it at the first partial or corrupt record
+     *
+     * If every late stamp is already in the log, a merge was interrupted after the log was replaced, so the late file is emptied. Call with the log mapped
+     */
+    void load_late(){
+        size_t bytes = file_size(lateFd);
+        size_t count = (bytes - sizeof(flatfileFormat::fileHeader)) / sizeof(flatfileFormat::stampRecord);
+        std::vector<flatfileFormat::stampRecord> recs(count);
+        if(count > 0 && pread(lateFd, recs.data(), count * sizeof(flatfileFormat::stampRecord), stampOffset(0)) != (ssize_t)(count * sizeof(flatfileFormat::stampRecord))){
+            throw std::runtime_error("Failed to read late stamp file");
+        }
+        lateRecords = 0;
+        bool allMerged = true;
+        for(auto & rec : recs){
+            if(!valid(rec)) break;
+            timeStamp stamp = unpack(rec);
+            add_late(stamp);
+            lateRecords++;
+            size_t i = lower_index(stamp.time);
+            bool inLog = false;
+            for(; i < stampCount && records[i].time == stamp.time && !inLog; i++) inLog = std::memcmp(records[i].uid, rec.uid, sizeof(rec.uid)) == 0;
+            allMerged = allMerged && inLog;
+        }
+        if(lateRecords > 0 && allMerged){
+            std::cout << "Late tracker entries were already merged, clearing them" << std::endl;
+            clear_late();
+        }else if(stampOffset(lateRecords) != bytes){
+            std::cerr << "Discarding " << bytes - stampOffset(lateRecords) << " bytes of incomplete late tracker entries" << std::endl;
+            if(ftruncate(lateFd, stampOffset(lateRecords)) != 0) throw std::runtime_error("Failed to truncate late stamp file");
+            sync_fd(lateFd);
+        }
+    }
+    void add_late(const timeStamp & stamp){
+        late.insert(late_upper(stamp.time), stamp);
+    }
+    void clear_late(){
+        if(ftruncate(lateFd, stampOffset(0)) != 0) throw std::runtime_error("Failed to truncate late stamp file");
+        if(durability.sync != syncLevel::off) sync_fd(lateFd);
+        late.clear();
+        lateRecords = 0;
+    }
+    /** \brief Record a stamp older than the latest, merging the late stamps into the log once there are enough */
+    void write_late(const timeStamp & stamp){
+        auto rec = pack(stamp);
+        write_all(lateFd, &rec, sizeof(rec), stampOffset(lateRecords));
+        if(durability.sync != syncLevel::off) sync_fd(lateFd); // Rare, so always durable
+        lateRecords++;
+        add_late(stamp);
+        if(late.size() >= late_limit()) merge_late();
+    }
+
+    /** \brief Rewrite the stamp log with the late stamps merged in, then empty the late file
+     *
+     * The log is written to a temporary file and renamed over the old one, so a crash leaves either. A crash before the late file is emptied leaves stamps in both, which load_late spots
+     */
+    void merge_late(){
+        ensure_mapped();
+        std::cout << "Merging " << late.size() << " late tracker entries into the stamp log" << std::endl;
+        std::string tmpName = stampFileName + ".tmp";
+        int tmpFd = ::open(tmpName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(tmpFd < 0) throw std::runtime_error("Failed to open temporary stamp file");
+        size_t written = 0;
+        try{
+            flatfileFormat::fileHeader header;
+            if(pread(stampFd, &header, sizeof(header), 0) != sizeof(header)) throw std::runtime_error("Failed to read stamp file header");
+            write_all(tmpFd, &header, sizeof(header), 0);
+            std::vector<flatfileFormat::stampRecord> buffer;
+            buffer.reserve(stampChunkSize);
+            auto drain = [&](){
+                write_all(tmpFd, buffer.data(), buffer.size() * sizeof(flatfileFormat::stampRecord), stampOffset(written));
+                written += buffer.size();
+                buffer.clear();
+            };
+            merge_range(0, stampCount, 0, late.size(), [&](const flatfileFormat::stampRecord & rec){
+                buffer.push_back(rec);
+                if(buffer.size() >= stampChunkSize) drain();
+            });
+            drain();
+            sync_fd(tmpFd);
+            if(rename(tmpName.c_str(), stampFileName.c_str()) != 0) throw std::runtime_error("Failed to replace stamp file");
+            sync_directory();
+        }catch(const std::runtime_error &e){
+            close(tmpFd);
+            unlink(tmpName.c_str());
+            throw;
+        }
+        if(mapping) munmap(mapping, mappedBytes);
+        mapping = nullptr;
+        records = nullptr;
+        mappedBytes = 0;
+        close(stampFd);
+        stampFd = tmpFd;
+        stampCount = written;
+        pendingSyncs = 0;
+        clear_late();
+    }
+
+    /** \brief Position of the first late stamp with time >= t (or > t if after) */
+    std::vector<timeStamp>::iterator late_lower(timecode t, bool after=false){
+        if(after) return std::upper_bound(late.begin(), late.end(), t, [](timecode v, const timeStamp & s){return v < s.time;});
+        return std::lower_bound(late.begin(), late.end(), t, [](const timeStamp & s, timecode v){return s.time < v;});
+    }
+    std::vector<timeStamp>::iterator late_upper(timecode t){return late_lower(t, true);}
+    size_t late_index(timecode t, bool after=false){return late_lower(t, after) - late.begin();}
+
+    /** \brief Call fn with log records [mainFrom, mainTo) and late stamps [lateFrom, lateTo) as records, in time order - a log record first at equal times */
+    template<typename F>
+    void merge_range(size_t mainFrom, size_t mainTo, size_t lateFrom, size_t lateTo, F fn){
+        while(mainFrom < mainTo || lateFrom < lateTo){
+            if(lateFrom >= lateTo || (mainFrom < mainTo && records[mainFrom].time <= late[lateFrom].time)){
+                fn(records[mainFrom++]);
+            }else{
+                fn(pack(late[lateFrom++]));
+            }
+        }
+    }
+
+    /** \brief Index of the first record with time >= t (or > t if after) */
+    size_t lower_index(timecode t, bool after=false){
+        ensure_mapped();
+        if(stampCount == 0) return 0;
+        if(after) return std::upper_bound(records, records + stampCount, t, [](timecode v, const flatfileFormat::stampRecord & r){return v < r.time;}) - records;
+        return std::lower_bound(records, records + stampCount, t, [](const flatfileFormat::stampRecord & r, timecode v){return r.time < v;}) - records;
+    }
+    /** \brief Pass stamps with time in [start, end] to sink in chunks, log and late merged. -1 for no bound */
+    void stream_range(timecode start, timecode end, const timeStampChunkSink & sink, size_t chunkSize){
+        ensure_mapped();
+        size_t from = start != -1 ? lower_index(start) : 0;
+        size_t to = end != -1 ? lower_index(end, true) : stampCount;
+        size_t lateFrom = start != -1 ? late_index(start) : 0;
+        size_t lateTo = end != -1 ? late_index(end, true) : late.size();
+        std::vector<timeStamp> chunk;
+        chunk.reserve(std::min(chunkSize, (to > from ? to - from : 0) + (lateTo > lateFrom ? lateTo - lateFrom : 0)));
+        if(lateFrom >= lateTo){
+            // Nothing late in range - straight off the map
+            for(size_t i = from; i < to; i++){
+                chunk.push_back(unpack(records[i]));
+                if(chunk.size() >= chunkSize){
+                    sink(chunk);
+                    chunk.clear();
+                }
+            }
+        }else{
+            merge_range(from, to, lateFrom, lateTo, [&](const flatfileFormat::stampRecord & rec){
+                chunk.push_back(unpack(rec));
+                if(chunk.size() >= chunkSize){
+                    sink(chunk);
+                    chunk.clear();
+                }
+            });
+        }
+        if(chunk.size() > 0) sink(chunk);
+    }
+
+  public:
+    flatfileStore(std::string baseName, durabilityConfig dur = durabilityConfig())
+        : stampFileName(baseName + ".stamps"), entityFileName(baseName + ".entities"), lateFileName(baseName + ".late"), durability(dur){
+        std::cout << "Opening flat files " << stampFileName << ", " << entityFileName << std::endl;
+        stampFd = open_file(stampFileName, flatfileFormat::stampMagic, sizeof(flatfileFormat::stampRecord));
+        try{
+            entityFd = open_file(entityFileName, flatfileFormat::entityMagic, 0);
+            lateFd = open_file(lateFileName, flatfileFormat::lateMagic, sizeof(flatfileFormat::stampRecord));
+            recover_stamp_tail();
+            load_entities();
+            remap();
+            load_late();
+        }catch(const std::runtime_error &e){
+            if(mapping) munmap(mapping, mappedBytes);
+            close(stampFd);
+            if(entityFd >= 0) close(entityFd);
+            if(lateFd >= 0) close(lateFd);
+            throw;
+        }
+    }
+    flatfileStore(const flatfileStore &other) = delete;
+    ~flatfileStore(){
+        try{
+            flush();
+        }catch(const std::runtime_error &e){
+            std::cerr << "Pending tracker entries may not be on disk: " << e.what() << std::endl;
+        }
+        if(mapping) munmap(mapping, mappedBytes);
+        if(stampFd >= 0) close(stampFd);
+        if(entityFd >= 0) close(entityFd);
+        if(lateFd >= 0) close(lateFd);
+    }
+
+    /** \brief Sync appends made since the last sync
+     *
+     * @param onlyIfDue Only sync if the batch has reached its size or age limit, and only under full sync
+     */
+    void flush(bool onlyIfDue=false){
+        if(pendingSyncs == 0 || durability.sync == syncLevel::off) return;
+        if(onlyIfDue){
+            if(durability.sync != syncLevel::full) return;
+            bool due = pendingSyncs >= durability.groupCommitSize || std::chrono::steady_clock::now() - batchOpened >= std::chrono::milliseconds(durability.groupCommitWindowMs);
+            if(!due) return;
+        }
+        sync_fd(stampFd);
+        pendingSyncs = 0;
+    }
+
+    void writeProject(const fullProjectData & dat){
+        std::string payload;
+        put<uint8_t>(payload, (uint8_t)flatfileFormat::entityType::project);
+        putUid(payload, dat.uid);
+        putString(payload, dat.name);
+        put<double>(payload, dat.FTE);
+        put<int64_t>(payload, dat.useStart ? dat.start : timecodeNull);
+        put<int64_t>(payload, dat.useEnd ? dat.end : timecodeNull);
+        put<uint8_t>(payload, (dat.useStart ? 1 : 0) | (dat.useEnd ? 2 : 0));
+        append_entity(payload);
+    }
+    void writeSubProject(const fullSubProjectData & dat){
+        if(!entities.hasProject(dat.parentUid)) throw std::runtime_error("Failed to write subproject"); // As the database foreign key
+        std::string payload;
+        put<uint8_t>(payload, (uint8_t)flatfileFormat::entityType::subproject);
+        putUid(payload, dat.uid);
+        putString(payload, dat.name);
+        put<double>(payload, dat.frac);
+        putUid(payload, dat.parentUid);
+        append_entity(payload);
+    }
+    void writeOneOff(const fullOneOffProjectData & dat){
+        std::string payload;
+        put<uint8_t>(payload, (uint8_t)flatfileFormat::entityType::oneoff);
+        putUid(payload, dat.uid);
+        putString(payload, dat.name);
+        putString(payload, dat.description);
+        append_entity(payload);
+    }
+    void writeTrackerEntry(const timeStamp & stamp){
+        ensure_mapped();
+        if(stampCount > 0 && stamp.time < records[stampCount - 1].time){
+            write_late(stamp);
+            return;
+        }
+        auto rec = pack(stamp);
+        write_all(stampFd, &rec, sizeof(rec), stampOffset(stampCount));
+        stampCount++;
+        if(pendingSyncs == 0) batchOpened = std::chrono::steady_clock::now();
+        pendingSyncs++;
+        flush(true);
+    }
+
+    fullProjectData readProject(proIds::Uuid const & id){return entities.readProject(id);}
+    fullSubProjectData readSubproject(proIds::Uuid const & id){return entities.readSubproject(id);}
+    fullOneOffProjectData readOneOff(proIds::Uuid const & id){return entities.readOneOff(id);}
+    std::vector<fullProjectData> fetchProjectList(){return entities.fetchProjectList();}
+    std::vector<fullProjectData> fetchProjectListActiveAt(timecode date){return entities.fetchProjectListActiveAt(date);}
+    std::vector<fullSubProjectData> fetchSubprojectList(){return entities.fetchSubprojectList();}
+    std::vector<fullSubProjectData> fetchSubprojectListForParents(std::vector<proIds::Uuid> ids){return entities.fetchSubprojectListForParents(ids);}
+    std::vector<fullOneOffProjectData> fetchOneOffList(){return entities.fetchOneOffList();}
+    /** \brief One entry per stamp strictly inside (start, end) which is for a one-off, as the database join */
+    std::vector<fullOneOffProjectData> fetchOneOffsInRange(timecode start, timecode end){
+        std::vector<fullOneOffProjectData> ret;
+        if(!entities.hasOneOffs()) return ret;
+        merge_range(lower_index(start, true), lower_index(end), late_index(start, true), late_index(end), [&](const flatfileFormat::stampRecord & rec){
+            if(auto oneoff = entities.findOneOff(unpack(rec).projectUid)) ret.push_back(*oneoff);
+        });
+        return ret;
+    }
+
+    std::vector<timeStamp> fetchTrackerEntries(timecode start=-1, timecode end=-1){
+        std::vector<timeStamp> ret;
+        streamTrackerEntries([&ret](const std::vector<timeStamp> & chunk){ret.insert(ret.end(), chunk.begin(), chunk.end());}, start, end);
+        return ret;
+    }
+    /** \brief Walk tracker entries in time order. The range is found by binary search over the mapped log */
+    void streamTrackerEntries(const timeStampChunkSink & sink, timecode start=-1, timecode end=-1, size_t chunkSize=stampChunkSize){
+        stream_range(start, end, sink, chunkSize);
+    }
+    /** \brief The latest entry - always in the log, as late stamps are older than it */
+    timeStamp fetchLatestTrackerEntry(){
+        ensure_mapped();
+        if(stampCount == 0) throw std::runtime_error("Failed to read timestamp");
+        return unpack(records[stampCount - 1]);
+    }
+    /** \brief The entry in force at time, or {timecodeNull, NullUid} if none is that early. Binary searches of the map and the late stamps */
+    timeStamp fetchTrackerEntryAt(timecode time){
+        size_t after = lower_index(time, true);
+        size_t lateAfter = late_index(time, true);
+        if(lateAfter > 0 && (after == 0 || late[lateAfter - 1].time >= records[after - 1].time)) return late[lateAfter - 1]; // Late wins ties - it sorts after
+        if(after == 0) return {timecodeNull, proIds::NullUid};
+        return unpack(records[after - 1]);
+    }
+    timeStamp fetchTrackerEntryAfter(timecode time){
+        size_t after = lower_index(time, true);
+        size_t lateAfter = late_index(time, true);
+        if(lateAfter < late.size() && (after >= stampCount || late[lateAfter].time < records[after].time)) return late[lateAfter];
+        if(after >= stampCount) return {timecodeNull, proIds::NullUid};
+        return unpack(records[after]);
+    }
+    timeStamp fetchEarliestTrackerEntry(){
+        ensure_mapped();
+        if(!late.empty() && (stampCount == 0 || late.front().time < records[0].time)) return late.front();
+        if(stampCount == 0) throw std::runtime_error("Failed to read timestamp");
+        return unpack(records[0]);
+    }
+
+    /** \brief Digests for days starting within [start, end], computed from the stamps
+     *
+     * Starts from the stamp open at start, and runs to the first stamp past the end of the last day, so days at both edges are complete
+     */
+    std::vector<dailyDigest> fetchDailyDigests(timecode start=-1, timecode end=-1){
+        ensure_mapped();
+        timecode from = -1, to = -1;
+        if(start != -1){
+            timeStamp running = fetchTrackerEntryAt(start - 1); // The stamp running at start
+            if(running.time != timecodeNull) from = running.time;
+        }
+        if(end != -1){
+            timeStamp closing = fetchTrackerEntryAfter(timeWrapper::nextDayStartSeconds(end) - 1); // Include the stamp closing the last day
+            if(closing.time != timecodeNull) to = closing.time;
+        }
+        dailyDigestAccumulator acc;
+        stream_range(from, to, [&acc](const std::vector<timeStamp> & chunk){acc.add(chunk);}, stampChunkSize);
+        std::vector<dailyDigest> ret;
+        for(auto & dg : acc.result()){
+            if((start == -1 || dg.day >= start) && (end == -1 || dg.day <= end)) ret.push_back(dg);
+        }
+        return ret;
+    }
+};
+
+#endif
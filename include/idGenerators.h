@@ -12,6 +12,9 @@
 
 #include <string>
 #include <iostream>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
 
 #include <QUuid>
 
@@ -55,6 +58,15 @@ namespace proIds{
         this->qID = QUuid::fromString(QString::fromStdString(str));
         this->Itag = uidTag::none;
       }
+
+      uidWrapper(const void * bytes, int length){
+        /** \brief Constructor from raw bytes
+        *
+        * Takes the 16 byte RFC 4122 form as produced by to_bytes, and sets the tag to none. Any other length gives the null id
+        */
+        this->qID = QUuid::fromRfc4122(QByteArrayView(static_cast<const char *>(bytes), length));
+        this->Itag = uidTag::none;
+      }
  
       /** \brief Apply tag
         @param tag Tag to apply
@@ -97,6 +109,17 @@ namespace proIds{
       /** \brief Stringify
       */
       std::string to_string()const{return qID.toString().toStdString();}
+      /** \brief Raw 16 byte form, in RFC 4122 (big-endian) order. Does not include the tag
+      */
+      QByteArray to_bytes()const{return qID.toRfc4122();}
+      /** \brief Hash of the core id, consistent with isEq. Does not include the tag
+      */
+      size_t hash()const{return qHash(qID);}
+  };
+
+  /** \brief Hash functor for unordered containers keyed on Uuid */
+  struct uidHash{
+    size_t operator()(const uidWrapper & uid)const{return uid.hash();}
   };
   
   inline bool operator==(const uidWrapper &lhs, const uidWrapper & rhs){ return lhs.isEq(rhs);};
@@ -116,6 +139,45 @@ namespace proIds{
   */
   const static Uuid NullUid = uidWrapper();
 
+  /** \brief Dense index for a Uuid, from a uidInterner
+  *
+  * Small and contiguous, so per-entity data can live in a flat array instead of a tree keyed on 16 byte ids. Only meaningful alongside the interner that issued it
+  */
+  typedef uint32_t denseId;
+
+  /** \brief Dense id of NullUid, in every interner */
+  const static denseId nullDenseId = 0;
+
+  /** \brief Maps each Uuid to a dense index, issued in order of first sight
+  *
+  * Look up once - e.g. when stamps are loaded - and work on the indices after. NullUid is always nullDenseId. As for Uuid equality, tags are ignored and the first-seen uid (with its tag) is the one given back
+  */
+  class uidInterner{
+    private:
+      std::unordered_map<Uuid, denseId, uidHash> index;
+      std::vector<Uuid> uids;/**< \brief Uuid for each dense id */
+
+    public:
+      uidInterner(){intern(NullUid);}
+
+      /** \brief Dense id for uid, issuing the next one if it is new */
+      denseId intern(const Uuid & uid){
+        auto it = index.emplace(uid, static_cast<denseId>(uids.size()));
+        if(it.second) uids.push_back(uid);
+        return it.first->second;
+      }
+      /** \brief Dense id for uid if it has been seen, else nullDenseId. Issues nothing */
+      denseId find(const Uuid & uid)const{
+        auto it = index.find(uid);
+        return it == index.end() ? nullDenseId : it->second;
+      }
+      /** \brief Uuid for a dense id from this interner */
+      const Uuid & uid(denseId id)const{return uids[id];}
+      /** \brief Number of ids issued, including NullUid. Every id is below this */
+      size_t size()const{return uids.size();}
+      void reserve(size_t count){index.reserve(count); uids.reserve(count);}
+  };
+
 };
 
 /** \brief Id generator parent class
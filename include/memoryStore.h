@@ -0,0 +1,216 @@
+#ifndef MEMORYSTORE_H
+#define MEMORYSTORE_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dataObjects.h"
+#include "idGenerators.h"
+#include "timestampProcessor.h"
+
+/** \brief Projects, subprojects and one-offs held in memory
+ *
+ * Returns the same orderings, tags and errors as the database store, so backends built on it are interchangeable. Writes replace any existing entry with the same id
+ */
+class entityStore{
+
+    std::map<proIds::Uuid, fullProjectData> projects;
+    std::map<proIds::Uuid, fullSubProjectData> subprojects;
+    std::map<proIds::Uuid, fullOneOffProjectData> oneoffs;
+
+  public:
+    void writeProject(const fullProjectData & dat){
+        fullProjectData stored = dat;
+        if(!stored.useStart) stored.start = timecodeNull;
+        if(!stored.useEnd) stored.end = timecodeNull;
+        projects[dat.uid] = stored;
+    }
+    void writeSubProject(const fullSubProjectData & dat){
+        if(projects.count(dat.parentUid) == 0) throw std::runtime_error("Failed to write subproject"); // As the database foreign key
+        fullSubProjectData stored = dat;
+        stored.uid.tag(proIds::uidTag::sub);
+        subprojects[dat.uid] = stored;
+    }
+    void writeOneOff(const fullOneOffProjectData & dat){
+        fullOneOffProjectData stored = dat;
+        stored.uid.tag(proIds::uidTag::oneoff);
+        oneoffs[dat.uid] = stored;
+    }
+
+    bool hasProject(proIds::Uuid const & id) const{return projects.count(id) > 0;}
+    bool hasOneOffs() const{return !oneoffs.empty();}
+    /** \brief The one-off with this id, or null if it is not one */
+    const fullOneOffProjectData * findOneOff(proIds::Uuid const & id) const{
+        auto it = oneoffs.find(id);
+        return it == oneoffs.end() ? nullptr : &it->second;
+    }
+
+    fullProjectData readProject(proIds::Uuid const & id) const{
+        auto it = projects.find(id);
+        if(it == projects.end()) throw std::runtime_error("Failed to read project");
+        fullProjectData ret = it->second;
+        ret.uid = id;
+        return ret;
+    }
+    fullSubProjectData readSubproject(proIds::Uuid const & id) const{
+        auto it = subprojects.find(id);
+        if(it == subprojects.end()) throw std::runtime_error("Failed to read subproject");
+        fullSubProjectData ret = it->second;
+        ret.uid = id;
+        return ret;
+    }
+    fullOneOffProjectData readOneOff(proIds::Uuid const & id) const{
+        auto it = oneoffs.find(id);
+        if(it == oneoffs.end()) throw std::runtime_error("Failed to read one off");
+        fullOneOffProjectData ret = it->second;
+        ret.uid = id;
+        return ret;
+    }
+
+    std::vector<fullProjectData> fetchProjectList() const{
+        std::vector<fullProjectData> ret;
+        for(auto & it : projects) ret.push_back(it.second);
+        std::stable_sort(ret.begin(), ret.end(), [](const fullProjectData & a, const fullProjectData & b){return a.name < b.name;});
+        return ret;
+    }
+    std::vector<fullProjectData> fetchProjectListActiveAt(timecode date) const{
+        std::vector<fullProjectData> ret;
+        for(auto & proj : fetchProjectList()){
+            if((!proj.useStart || proj.start <= date) && (!proj.useEnd || proj.end >= date)) ret.push_back(proj);
+        }
+        return ret;
+    }
+    std::vector<fullSubProjectData> fetchSubprojectList() const{
+        std::vector<fullSubProjectData> ret;
+        for(auto & it : subprojects) ret.push_back(it.second);
+        std::stable_sort(ret.begin(), ret.end(), [](const fullSubProjectData & a, const fullSubProjectData & b){
+            if(a.parentUid != b.parentUid) return a.parentUid < b.parentUid;
+            return a.name < b.name;
+        });
+        return ret;
+    }
+    std::vector<fullSubProjectData> fetchSubprojectListForParents(std::vector<proIds::Uuid> ids) const{
+        std::sort(ids.begin(), ids.end());
+        std::vector<fullSubProjectData> ret;
+        for(auto & sub : fetchSubprojectList()){
+            if(std::binary_search(ids.begin(), ids.end(), sub.parentUid)) ret.push_back(sub);
+        }
+        return ret;
+    }
+    std::vector<fullOneOffProjectData> fetchOneOffList() const{
+        std::vector<fullOneOffProjectData> ret;
+        for(auto & it : oneoffs) ret.push_back(it.second);
+        std::stable_sort(ret.begin(), ret.end(), [](const fullOneOffProjectData & a, const fullOneOffProjectData & b){return a.name < b.name;});
+        return ret;
+    }
+};
+
+/**
+ * @brief Store holding everything in memory, for tests, benchmarks and short-lived report runs
+ *
+ * Tracker entries are kept in a vector sorted on time, so range fetches are binary searches. Appending in time order is amortised O(1); an older stamp is inserted at its place, O(n). Nothing is persisted
+ */
+class memoryStore{
+
+    entityStore entities;
+    std::vector<timeStamp> stamps; /**< \brief Sorted on time. Equal times stay in write order */
+
+    std::vector<timeStamp>::const_iterator lower(timecode t) const{
+        return std::lower_bound(stamps.begin(), stamps.end(), t, [](const timeStamp & s, timecode v){return s.time < v;});
+    }
+    std::vector<timeStamp>::const_iterator upper(timecode t) const{
+        return std::upper_bound(stamps.begin(), stamps.end(), t, [](timecode v, const timeStamp & s){return v < s.time;});
+    }
+
+  public:
+    void writeProject(const fullProjectData & dat){entities.writeProject(dat);}
+    void writeSubProject(const fullSubProjectData & dat){entities.writeSubProject(dat);}
+    void writeOneOff(const fullOneOffProjectData & dat){entities.writeOneOff(dat);}
+    void writeTrackerEntry(const timeStamp & stamp){
+        if(stamps.empty() || stamp.time >= stamps.back().time){
+            stamps.push_back(stamp);
+        }else{
+            stamps.insert(upper(stamp.time), stamp);
+        }
+    }
+    /** \brief Pre-allocate for a known number of tracker entries */
+    void reserve(size_t count){stamps.reserve(count);}
+
+    fullProjectData readProject(proIds::Uuid const & id){return entities.readProject(id);}
+    fullSubProjectData readSubproject(proIds::Uuid const & id){return entities.readSubproject(id);}
+    fullOneOffProjectData readOneOff(proIds::Uuid const & id){return entities.readOneOff(id);}
+    std::vector<fullProjectData> fetchProjectList(){return entities.fetchProjectList();}
+    std::vector<fullProjectData> fetchProjectListActiveAt(timecode date){return entities.fetchProjectListActiveAt(date);}
+    std::vector<fullSubProjectData> fetchSubprojectList(){return entities.fetchSubprojectList();}
+    std::vector<fullSubProjectData> fetchSubprojectListForParents(std::vector<proIds::Uuid> ids){return entities.fetchSubprojectListForParents(ids);}
+    std::vector<fullOneOffProjectData> fetchOneOffList(){return entities.fetchOneOffList();}
+
+    /** \brief One entry per stamp strictly inside (start, end) which is for a one-off, as the database join */
+    std::vector<fullOneOffProjectData> fetchOneOffsInRange(timecode start, timecode end){
+        std::vector<fullOneOffProjectData> ret;
+        if(!entities.hasOneOffs()) return ret;
+        for(auto it = upper(start), stop = lower(end); it < stop; it++){
+            if(auto oneoff = entities.findOneOff(it->projectUid)) ret.push_back(*oneoff);
+        }
+        return ret;
+    }
+
+    std::vector<timeStamp> fetchTrackerEntries(timecode start=-1, timecode end=-1){
+        auto from = start != -1 ? lower(start) : stamps.begin();
+        auto to = end != -1 ? upper(end) : stamps.end();
+        if(from >= to) return {};
+        return std::vector<timeStamp>(from, to);
+    }
+    void streamTrackerEntries(const timeStampChunkSink & sink, timecode start=-1, timecode end=-1, size_t chunkSize=stampChunkSize){
+        auto from = start != -1 ? lower(start) : stamps.begin();
+        auto to = end != -1 ? upper(end) : stamps.end();
+        std::vector<timeStamp> chunk;
+        while(from < to){
+            auto next = to - from > (long)chunkSize ? from + chunkSize : to;
+            chunk.assign(from, next);
+            sink(chunk);
+            from = next;
+        }
+    }
+    timeStamp fetchLatestTrackerEntry(){
+        if(stamps.empty()) throw std::runtime_error("Failed to read timestamp");
+        return stamps.back();
+    }
+    /** \brief The entry in force at time, or {timecodeNull, NullUid} if none is that early */
+    timeStamp fetchTrackerEntryAt(timecode time){
+        auto after = upper(time);
+        if(after == stamps.begin()) return {timecodeNull, proIds::NullUid};
+        return *(after - 1);
+    }
+    timeStamp fetchTrackerEntryAfter(timecode time){
+        auto after = upper(time);
+        if(after == stamps.end()) return {timecodeNull, proIds::NullUid};
+        return *after;
+    }
+    timeStamp fetchEarliestTrackerEntry(){
+        if(stamps.empty()) throw std::runtime_error("Failed to read timestamp");
+        return stamps.front();
+    }
+
+    /** \brief Digests for days starting within [start, end], computed from the stamps
+     *
+     * Starts from the stamp open at start, and runs to the first stamp past the end of the last day, so days at both edges are complete
+     */
+    std::vector<dailyDigest> fetchDailyDigests(timecode start=-1, timecode end=-1){
+        auto from = start != -1 ? lower(start) : stamps.begin();
+        if(from != stamps.begin()) from--; // The stamp running at start
+        auto to = end != -1 ? lower(timeWrapper::nextDayStartSeconds(end)) : stamps.end();
+        if(to != stamps.end()) to++; // Include the stamp closing the last day
+        dailyDigestAccumulator acc;
+        for(auto it = from; it < to; it++) acc.add(*it);
+        std::vector<dailyDigest> ret;
+        for(auto & dg : acc.result()){
+            if((start == -1 || dg.day >= start) && (end == -1 || dg.day <= end)) ret.push_back(dg);
+        }
+        return ret;
+    }
+};
+
+#endif
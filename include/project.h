@@ -8,6 +8,7 @@
 
 #include "idGenerators.h"
 #include "dataObjects.h"
+#include "slotMap.h"
 
 
 enum class specialEventType{
@@ -116,7 +117,8 @@ class project : public projectLike{
     float FTE;/**< \brief Fraction of FTE for this project */
     bool hasStart=false, hasEnd=false; /**< Whether or not there is a start or end */
     timecode start=timecodeNull, end=timecodeNull; /**< Time for the start and end */
-    std::vector<proIds::Uuid> subprojects;/**< \brief Subprojects belonging to this project */
+    std::vector<slotHandle> subprojects;/**< \brief Handles to the subprojects belonging to this project, held by the projectManager */
+    double assignedSubFrac = 0.0;/**< \brief Sum of the subprojects' fractions, kept up to date by the projectManager */
   public:
     project() = default;
     project(const fullProjectData &data){
@@ -139,7 +141,7 @@ class project : public projectLike{
         end = data.end;
         active = true;
     };
-    void addSubproject(proIds::Uuid sub_id){subprojects.push_back(sub_id);}
+    void addSubproject(slotHandle sub){subprojects.push_back(sub);}
     ~project()=default;
 
     float getFTE(){return FTE;}
@@ -0,0 +1,107 @@
+#ifndef ____projectListIndex_h__
+#define ____projectListIndex_h__
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "idGenerators.h"
+#include "project.h"
+
+/** \brief One change to the ordered project list - an entry inserted at, or removed from, a position */
+struct projectListDelta{
+  enum class change{inserted, removed};
+  change type;
+  size_t position; /**< \brief Position in the full list, projects and subprojects */
+  size_t topPosition; /**< \brief Position among top-level projects only. Meaningless for subprojects */
+  selectableEntity entity;
+};
+
+/**
+ * @brief The displayed project list, kept in order as entries come and go
+ *
+ * The order is as getOrderedProjectList always gave - projects by name, each followed by its subprojects by name. Every row carries its top-level project's name and uid, so the whole list sorts on one key and an entry's place is a binary search. Equal names are ordered on uid.
+ * Changes are returned as deltas, applied in the order given, so a display can follow along without rebuilding. Rows are held in a vector, so making room is a shift of the rows after - trivial at any realistic project count, and a plain walk gives the whole list
+ */
+class projectListIndex{
+
+    struct row{
+      std::string topName; /**< \brief Name of the project, or the subproject's parent */
+      proIds::Uuid topUid;
+      selectableEntity entity;
+    };
+    std::vector<row> rows;
+    std::vector<row> tops; /**< \brief Top level rows only, to place them among each other */
+
+    static bool before(const row & a, const row & b){
+      if(a.topName != b.topName) return a.topName < b.topName;
+      if(!(a.topUid == b.topUid)) return a.topUid < b.topUid;
+      if(a.entity.level != b.entity.level) return a.entity.level < b.entity.level; // Project before its subs
+      if(a.entity.name != b.entity.name) return a.entity.name < b.entity.name;
+      return a.entity.uid < b.entity.uid;
+    }
+    static row topRow(const selectableEntity & proj){return {proj.name, proj.uid, proj};}
+
+    size_t insertRow(const row & r){
+      auto it = std::lower_bound(rows.begin(), rows.end(), r, before);
+      size_t pos = it - rows.begin();
+      rows.insert(it, r);
+      return pos;
+    }
+
+  public:
+    std::vector<selectableEntity> list() const{
+      std::vector<selectableEntity> ret;
+      ret.reserve(rows.size());
+      for(auto & r : rows) ret.push_back(r.entity);
+      return ret;
+    }
+    size_t size() const{return rows.size();}
+    void clear(){
+      rows.clear();
+      tops.clear();
+    }
+
+    projectListDelta insertProject(const selectableEntity & proj){
+      row r = topRow(proj);
+      auto it = std::lower_bound(tops.begin(), tops.end(), r, before);
+      size_t topPos = it - tops.begin();
+      tops.insert(it, r);
+      return {projectListDelta::change::inserted, insertRow(r), topPos, proj};
+    }
+    projectListDelta insertSubproject(const selectableEntity & sub, const selectableEntity & parent){
+      size_t pos = insertRow({parent.name, parent.uid, sub});
+      return {projectListDelta::change::inserted, pos, 0, sub};
+    }
+
+    /** \brief Remove a project and any subprojects listed under it. Subprojects come first in the deltas, last to first, so each position holds when it is applied */
+    std::vector<projectListDelta> removeProject(const selectableEntity & proj){
+      std::vector<projectListDelta> ret;
+      row r = topRow(proj);
+      auto topIt = std::lower_bound(tops.begin(), tops.end(), r, before);
+      if(topIt == tops.end() || !(topIt->entity.uid == proj.uid)) return ret; // Not listed
+      size_t topPos = topIt - tops.begin();
+      tops.erase(topIt);
+
+      auto first = std::lower_bound(rows.begin(), rows.end(), r, before);
+      auto last = first + 1;
+      while(last != rows.end() && last->topUid == proj.uid) last++;
+      for(auto it = last; it != first + 1; ){
+        --it;
+        ret.push_back({projectListDelta::change::removed, size_t(it - rows.begin()), 0, it->entity});
+      }
+      ret.push_back({projectListDelta::change::removed, size_t(first - rows.begin()), topPos, first->entity});
+      rows.erase(first, last);
+      return ret;
+    }
+    /** \brief Remove one subproject. Returns false, changing nothing, if it is not listed */
+    bool removeSubproject(const selectableEntity & sub, const selectableEntity & parent, projectListDelta & delta){
+      auto it = std::lower_bound(rows.begin(), rows.end(), row{parent.name, parent.uid, sub}, before);
+      if(it == rows.end() || !(it->entity.uid == sub.uid)) return false;
+      delta = {projectListDelta::change::removed, size_t(it - rows.begin()), 0, it->entity};
+      rows.erase(it);
+      return true;
+    }
+};
+
+#endif
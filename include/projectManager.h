@@ -2,28 +2,80 @@
 #ifndef ____projectManager__
 #define ____projectManager__
 
+#include <algorithm>
+#include <cmath>
+#include <iostream>
 #include <map>
 #include <sstream>
+#include <unordered_map>
 
 #include "project.h"
+#include "projectListIndex.h"
+#include "activationSchedule.h"
 #include "dataObjects.h"
 
-// TODO - some sort of periodic check of project active status in case app is running through start/end dates
-
 /** \brief Holds and manages projects
 *
 * Deals with listing of projects, delegating assignments of Uids etc
+* Projects and subprojects each live packed in a slotMap, found from their Uid through one hash index. Projects reach their subprojects by handle, so no child access is a search
+* Start and end dates are queued in an activationSchedule, so as time moves (updateActiveAt) only projects passing a date are looked at
  */
 class projectManager{
 
   private:
    IdGenerator * gen = nullptr;/**< \brief Uid generator to use */
 
-    std::map<proIds::Uuid, project> projects; /**< \brief Project store. Contains projects only*/
-    std::map<proIds::Uuid, subproject> subprojects; /**< \brief Subproject store. Contains subprojects only*/
-    float activeFTE = 0.0;
+    slotMap<project> projects; /**< \brief Project store. Contains projects only*/
+    slotMap<subproject> subprojects; /**< \brief Subproject store. Contains subprojects only*/
+    std::unordered_map<proIds::Uuid, slotHandle, proIds::uidHash> handles; /**< \brief Handle for every project and subproject. The sub tag says which store */
+    projectListIndex listed; /**< \brief Active projects and their subprojects, in display order */
+    std::vector<projectListDelta> listChanges; /**< \brief Changes to listed not yet collected */
+    activationSchedule schedule; /**< \brief Start and end transitions of every project */
+    double activeFTE = 0.0; /**< \brief Sum of FTE over active projects, kept as they come and go */
     float maxFTE = 1.0;
     void setupGenerator(){this->gen = new uniqueIdGenerator();}; 
+
+    project * findProject(const proIds::Uuid & uid){
+      if(uid.isTaggedAs(proIds::uidTag::sub)) return nullptr;
+      auto it = handles.find(uid);
+      return it == handles.end() ? nullptr : projects.get(it->second);
+    }
+    subproject * findSubproject(const proIds::Uuid & uid){
+      if(!uid.isTaggedAs(proIds::uidTag::sub)) return nullptr;
+      auto it = handles.find(uid);
+      return it == handles.end() ? nullptr : subprojects.get(it->second);
+    }
+
+    void listProject(project & proj){
+      listChanges.push_back(listed.insertProject(proj));
+    }
+    void listSubproject(subproject & sub){
+      auto parent = findProject(sub.getParentUid());
+      if(!parent || !parent->active) return; // Shown only under an active parent
+      listChanges.push_back(listed.insertSubproject(sub, *parent));
+    }
+    void unlistProject(project & proj){
+      auto removed = listed.removeProject(proj);
+      listChanges.insert(listChanges.end(), removed.begin(), removed.end());
+    }
+
+    static timecode scheduledStart(const project & proj){return proj.hasStart ? proj.start : timecodeNull;}
+    static timecode scheduledEnd(const project & proj){return proj.hasEnd ? proj.end : timecodeNull;}
+    /** \brief Flip a project's active state, carrying its FTE and its listing - with subprojects - along */
+    void setActive(project & proj, bool active){
+      if(active == proj.active) return;
+      proj.active = active;
+      if(active){
+        activeFTE += proj.FTE;
+        listProject(proj);
+        for(auto & handle : proj.subprojects){
+          if(auto sub = subprojects.get(handle)) listSubproject(*sub);
+        }
+      }else{
+        activeFTE -= proj.FTE;
+        unlistProject(proj);
+      }
+    }
   public:
 
     projectManager(){setupGenerator();};
@@ -37,34 +89,69 @@ class projectManager{
     bool checkFTE(float requested){return (activeFTE + requested) <= maxFTE + 1e-5;} //Tiny rounding error allowance
 
     float availableSubFrac(const proIds::Uuid & proj){
-      if(projects.count(proj) > 0){
-        return availableSubFrac(projects[proj]);
+      if(auto found = findProject(proj)){
+        return availableSubFrac(*found);
       }else{
         return 0.0;
       }
     }
-    float availableSubFrac(const project & proj){
-      float total = 0.0;
-      for(auto & sub : proj.subprojects){
-        total += subprojects[sub].getFrac();
-      }
-      return 1.0 - total;
-    }
+    float availableSubFrac(const project & proj){return 1.0 - proj.assignedSubFrac;}
     bool checkFrac(const proIds::Uuid & proj){
       return availableSubFrac(proj) > 0.0;
     }
 
+    /**
+     * @brief Recompute the FTE and subproject fraction totals from scratch and compare with those kept
+     *
+     * Slow - walks everything, so run once after a bulk load or from the bench, not per change
+     * @returns False, after listing each mismatch to cerr, if any total is out by more than rounding
+     */
+    bool checkAggregates(){
+      const double tolerance = 1e-4;
+      bool ok = true;
+      double fte = 0.0;
+      for(auto & proj : projects){
+        if(proj.active) fte += proj.FTE;
+        double frac = 0.0;
+        for(auto & handle : proj.subprojects){
+          if(auto sub = subprojects.get(handle)) frac += sub->frac;
+        }
+        if(std::abs(frac - proj.assignedSubFrac) > tolerance){
+          std::cerr << "Subproject fraction for " << proj.name << " is " << proj.assignedSubFrac << ", recomputed " << frac << std::endl;
+          ok = false;
+        }
+      }
+      if(std::abs(fte - activeFTE) > tolerance){
+        std::cerr << "Allocated FTE is " << activeFTE << ", recomputed " << fte << std::endl;
+        ok = false;
+      }
+      return ok;
+    }
+
+    /** \brief checkAggregates in debug builds only, reporting any drift */
+    void verifyAggregates(){
+#ifndef NDEBUG
+      if(!checkAggregates()) std::cerr << "Project allocation totals out of step" << std::endl;
+#endif
+    }
+
     project createProject(const projectData & data){
       return project(data, gen->getNextId());
     }
     subproject createSubproject(const subProjectData & data, const proIds::Uuid & parentUid){
       return subproject(data, gen->getNextId(proIds::uidTag::sub), parentUid); 
     }
-    proIds::Uuid addProject(const projectData & dat){
+    /** \brief Add a new project, active or not as its dates say at now - as restoreProject */
+    proIds::Uuid addProject(const projectData & dat, timecode now){
       if(!checkFTE(dat.FTE)) throw std::runtime_error("Not enough FTE to add project");
       project tmp = createProject(dat); 
-      projects[tmp.getUid()] = tmp;
-      activeFTE += tmp.FTE;
+      bool active = activationSchedule::activeAt(scheduledStart(tmp), scheduledEnd(tmp), now);
+      tmp.active = false;
+      auto handle = projects.insert(tmp);
+      handles[tmp.getUid()] = handle;
+      if(schedule.time() == timecodeNull) schedule.setTime(now);
+      schedule.add(tmp.uid, scheduledStart(tmp), scheduledEnd(tmp));
+      setActive(*projects.get(handle), active);
       return tmp.getUid();
     }
 
@@ -72,29 +159,73 @@ class projectManager{
       if(parentUid.isTaggedAs(proIds::uidTag::sub)) throw std::runtime_error("Parent must not be a subproject"); //TODO re-examine this?
       if(!checkFrac(parentUid)) throw std::runtime_error("Fraction too large to add subproject");
       subproject tmp = createSubproject(dat, parentUid);
-      subprojects[tmp.getUid()] = tmp;
-      projects[parentUid].addSubproject(tmp.getUid());
+      auto handle = subprojects.insert(tmp);
+      handles[tmp.getUid()] = handle;
+      project * parent = findProject(parentUid);
+      parent->addSubproject(handle);
+      parent->assignedSubFrac += tmp.frac;
+      listSubproject(*subprojects.get(handle));
       return tmp.getUid();
     }
 
-    bool isProject(proIds::Uuid id ){return projects.count(id) > 0;};
-    bool isSubProject(proIds::Uuid id ){return subprojects.count(id) > 0;};
+    bool isProject(proIds::Uuid id ){return findProject(id) != nullptr;};
+    bool isSubProject(proIds::Uuid id ){return findSubproject(id) != nullptr;};
+    /** \brief Uid of every project and subproject held, active or not */
+    std::vector<proIds::Uuid> getKnownUids(){
+      std::vector<proIds::Uuid> ret;
+      ret.reserve(handles.size());
+      for(auto & it : handles) ret.push_back(it.first);
+      return ret;
+    }
 
     proIds::Uuid getNextOneOffId(){
       return gen->getNextId(proIds::uidTag::oneoff);
     }
 
+    /** \brief Restore a project from e.g. file - i.e. one that already HAS a uid
+     *
+     * Active or not as its dates say at now. The first restore sets the schedule's time, so later ones should pass the same now, or call updateActiveAt first
+     */
     void restoreProject(const fullProjectData & dat, timecode now){
-      //Restore a project from e.g. file - i.e. one that already HAS a uid
       auto id = dat.uid;
       if(!id.isTaggedAs(proIds::uidTag::none)) throw std::runtime_error("Id is not for a project");
       project tmp = project(dat);
-      bool active = true;
-      if(tmp.hasStart && tmp.start > now) active = false;
-      if(tmp.hasEnd && tmp.end < now) active = false;
-      tmp.active = active;
-      projects[id] = tmp;
-      activeFTE += dat.FTE;
+      bool active = activationSchedule::activeAt(scheduledStart(tmp), scheduledEnd(tmp), now);
+      tmp.active = false;
+      project * proj = findProject(id);
+      if(proj){
+        // Replaced - keeps its subprojects
+        setActive(*proj, false);
+        schedule.remove(id, scheduledStart(*proj), scheduledEnd(*proj));
+        tmp.subprojects = proj->subprojects;
+        tmp.assignedSubFrac = proj->assignedSubFrac;
+        *proj = tmp;
+      }else{
+        proj = projects.get(handles[id] = projects.insert(tmp));
+      }
+      if(schedule.time() == timecodeNull) schedule.setTime(now);
+      schedule.add(id, scheduledStart(*proj), scheduledEnd(*proj));
+      setActive(*proj, active);
+    }
+
+    /**
+     * @brief Bring active states up to time now - forwards, or backwards after a time travel
+     *
+     * Only projects with a start or end passed since the last call are looked at, so calling this on every clock tick costs one search when nothing is due. Changes to the list are queued as usual
+     * @returns True if any project changed state
+     */
+    bool updateActiveAt(timecode now){
+      bool changed = false;
+      for(auto & uid : schedule.advanceTo(now)){
+        project * proj = findProject(uid);
+        if(!proj) continue;
+        bool active = activationSchedule::activeAt(scheduledStart(*proj), scheduledEnd(*proj), now);
+        if(active == proj->active) continue;
+        std::cout << "Project " << proj->name << (active ? " started" : " ended") << std::endl;
+        setActive(*proj, active);
+        changed = true;
+      }
+      return changed;
     }
 
     void restoreSubproject(const fullSubProjectData & dat){
@@ -103,21 +234,41 @@ class projectManager{
       auto parentUid = dat.parentUid;
       if(parentUid.isTaggedAs(proIds::uidTag::sub)) throw std::runtime_error("Parent must not be a subproject");
       if(!id.isTaggedAs(proIds::uidTag::sub)) throw std::runtime_error("Id is not for a subproject");
-      if(projects.count(parentUid) == 0 ) throw std::runtime_error("Parent project does not exist");
-      subprojects[id] = subproject(dat);
-      projects[parentUid].addSubproject(id); // TODO - check if sub already associated?
+      project * parent = findProject(parentUid);
+      if(!parent) throw std::runtime_error("Parent project does not exist");
+      slotHandle handle;
+      if(subproject * existing = findSubproject(id)){
+        // Already held - detach from its old parent, which may be this one
+        handle = handles[id];
+        if(auto oldParent = findProject(existing->getParentUid())){
+          projectListDelta removed;
+          if(listed.removeSubproject(*existing, *oldParent, removed)) listChanges.push_back(removed);
+          oldParent->assignedSubFrac -= existing->frac;
+          auto & siblings = oldParent->subprojects;
+          siblings.erase(std::remove(siblings.begin(), siblings.end(), handle), siblings.end());
+        }
+        *existing = subproject(dat);
+      }else{
+        handle = subprojects.insert(subproject(dat));
+        handles[id] = handle;
+      }
+      parent->addSubproject(handle);
+      parent->assignedSubFrac += dat.frac;
+      listSubproject(*subprojects.get(handle));
     }
 
     /** \brief Get list of projects
      * 
      * Returns a COPY vector of the projects. They are in order - so subprojects follow their parent
+     * The active list is kept as projects come and go, so is only copied out. Including inactive projects sorts afresh
      */
     std::vector<selectableEntity> getOrderedProjectList(bool activeOnly=true){
+      if(activeOnly) return listed.list();
       std::vector<selectableEntity> ret, proj;
       for(auto & it : projects){
         // Include all OR active projects only
-        if(!activeOnly || it.second.active){
-          proj.push_back(it.second);
+        if(!activeOnly || it.active){
+          proj.push_back(it);
         }
       }
       //Sorting the list
@@ -127,8 +278,8 @@ class projectManager{
       for(auto it = proj.begin(); it != proj.end(); it++){
         ret.push_back(*it);
         std::vector<selectableEntity> subs;
-        for(auto & it2 : projects[it->uid].subprojects){
-          subs.push_back(subprojects[it2]);
+        for(auto & handle : findProject(it->uid)->subprojects){
+          if(auto sub = subprojects.get(handle)) subs.push_back(*sub);
         }
         //Sorting subs - by fraction or by name?
         std::sort(subs.begin(), subs.end(), [](selectableEntity a, selectableEntity b){return a.name < b.name;});
@@ -142,8 +293,8 @@ class projectManager{
     std::vector<selectableEntity> getToplevelProjectList(){
       std::vector<selectableEntity> ret;
       for(auto & it : projects){
-        if(!it.second.getUid().isTaggedAs(proIds::uidTag::oneoff)){
-          ret.push_back(it.second);
+        if(!it.getUid().isTaggedAs(proIds::uidTag::oneoff)){
+          ret.push_back(it);
         }
       }
       std::sort(ret.begin(), ret.end(),[](selectableEntity a, selectableEntity b){return a.name < b.name;});
@@ -152,11 +303,11 @@ class projectManager{
 
     // Subprojects getting
     const std::vector<project *> getOrderedProjectRefs(){
-      //List of refs to the actual projects, so can access full info
+      //List of refs to the actual projects, so can access full info. Valid until projects are next added or removed
       std::vector<project *> refs;
       for(auto & it : projects){
-        if(it.second.getUid().isTaggedAs(proIds::uidTag::none)){
-          refs.push_back(&it.second);
+        if(it.getUid().isTaggedAs(proIds::uidTag::none)){
+          refs.push_back(&it);
         }
       }
       std::sort(refs.begin(), refs.end(), [](project * a, project * b){return a->getName() < b->getName();});
@@ -166,33 +317,46 @@ class projectManager{
     const std::vector<subproject *> getOrderedSubRefs(project & proj){
       //List of refs to sub, from a project ref
       std::vector<subproject *> refs;
-      for(auto & sub : proj.subprojects){
-        refs.push_back(&subprojects[sub]);
+      for(auto & handle : proj.subprojects){
+        if(auto sub = subprojects.get(handle)) refs.push_back(sub);
       }
       std::sort(refs.begin(), refs.end(), [](subproject * a, subproject * b){return a->getName() < b->getName();});
       return refs;
     }
 
-    void deleteProjectById(proIds::Uuid uid){projects.erase(uid);};
+    /** \brief Changes to the active list since the last call, in the order to apply them. Clears them */
+    std::vector<projectListDelta> takeListChanges(){
+      std::vector<projectListDelta> ret;
+      ret.swap(listChanges);
+      return ret;
+    }
+
+    void deleteProjectById(proIds::Uuid uid){
+      auto proj = findProject(uid);
+      if(!proj) return;
+      setActive(*proj, false);
+      schedule.remove(uid, scheduledStart(*proj), scheduledEnd(*proj));
+      projects.erase(handles[uid]);
+      handles.erase(uid);
+    };
 
     proIds::Uuid getNullUid(){return gen->getNullId();};
     proIds::Uuid getNewUid(){return gen->getNextId();};
     proIds::Uuid getNewUid(proIds::uidTag tag){return gen->getNextId(tag);};
   
     std::string getName(proIds::Uuid uid){
-      if(projects.find(uid) != projects.end()){
-        return projects[uid].getName();
-      }else if(subprojects.find(uid) != subprojects.end()){
-        return subprojects[uid].getName();
+      if(auto proj = findProject(uid)){
+        return proj->getName();
+      }else if(auto sub = findSubproject(uid)){
+        return sub->getName();
       }else{
         return "Unknown Project";
       }
     }
     std::string getParentNameForSub(proIds::Uuid uid){
-      if(subprojects.find(uid) != subprojects.end()){
-        proIds::Uuid parentUid = subprojects[uid].getParentUid();
-        if(projects.find(parentUid) != projects.end()){
-          return projects[parentUid].getName();
+      if(auto sub = findSubproject(uid)){
+        if(auto parent = findProject(sub->getParentUid())){
+          return parent->getName();
         }else{
           return "Unknown Parent Project";
         }
@@ -202,22 +366,25 @@ class projectManager{
     }
 
     projectDetails getDetails(proIds::Uuid uid){
+      if(auto found = findProject(uid)) return getDetails(*found);
       projectDetails details; 
       details.uid = uid;
-      if(projects.count(uid) > 0){
-        auto & proj = projects[uid];
-        details.name = proj.name;
-        details.FTE = proj.FTE;
-        details.subprojectCount = proj.subprojects.size();
-        details.assignedSubprojFraction = 1.0 - availableSubFrac(proj);
-        details.active = true;
-      }
+      return details;
+    }
+    projectDetails getDetails(const project & proj){
+      projectDetails details; 
+      details.uid = proj.uid;
+      details.name = proj.name;
+      details.FTE = proj.FTE;
+      details.subprojectCount = proj.subprojects.size();
+      details.assignedSubprojFraction = proj.assignedSubFrac;
+      details.active = true;
       return details;
     }
     std::map<proIds::Uuid, projectDetails> getDetailsForAll(){
       std::map<proIds::Uuid, projectDetails> ret;
       for(auto & it : projects){
-        ret[it.first] = getDetails(it.first);
+        ret[it.uid] = getDetails(it);
       }
       return ret;
     }
@@ -233,13 +400,12 @@ class projectManager{
       }
       std::stringstream ss;
 
-      if(projects.find(uid) != projects.end()){
-        project & proj = projects[uid];
+      if(auto found = findProject(uid)){
+        project & proj = *found;
         ss << proj.describe()<<'\n';
-        for(auto & subId : proj.subprojects){
-          if(subprojects.find(subId) != subprojects.end()){
-            subproject & sub = subprojects[subId];
-            ss << sub.describe();
+        for(auto & handle : proj.subprojects){
+          if(auto sub = subprojects.get(handle)){
+            ss << sub->describe();
           }// Else case should just not happen so ignore it
         }
         return ss.str();
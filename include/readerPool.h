@@ -0,0 +1,84 @@
+#ifndef ____readerPool__
+#define ____readerPool__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dataInterface.h"
+
+/**
+ * @brief Worker threads for long reads, each with its own read handle onto the data
+ *
+ * Handles come from dataIO::openReader, opened on the constructing thread, so tasks never touch the handle the app writes through. If the backend cannot give one no workers start - check available() and do the work in place instead.
+ * Tasks run in the order submitted. Nothing here cancels a running task - tasks check for themselves whether they are still wanted - but ones not yet started can be dropped
+ */
+class readerPool{
+
+  std::vector<std::unique_ptr<dataIO>> readers;
+  std::vector<std::thread> workers;
+  std::deque<std::function<void(dataIO &)>> tasks; /**< \brief Guarded by mutex */
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false; /**< \brief Guarded by mutex */
+
+  void workerLoop(dataIO & reader){
+    while(true){
+      std::function<void(dataIO &)> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]{return stopping || !tasks.empty();});
+        if(stopping) return;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      try{
+        task(reader);
+      }catch(const std::exception &e){
+        std::cerr << "Background read failed: " << e.what() << std::endl; // Tasks should report their own failures - this is the backstop
+      }
+    }
+  }
+
+  public:
+    readerPool(dataIO & source, size_t count=1){
+      for(size_t i = 0; i < count; i++){
+        dataIO * reader = source.openReader();
+        if(!reader) break;
+        readers.emplace_back(reader);
+      }
+      for(auto & reader : readers) workers.emplace_back(&readerPool::workerLoop, this, std::ref(*reader));
+    }
+    readerPool(const readerPool &other) = delete;
+    /** \brief Drops tasks not yet started and waits for running ones to finish */
+    ~readerPool(){
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        tasks.clear();
+      }
+      wake.notify_all();
+      for(auto & w : workers) w.join();
+    }
+
+    bool available() const{return !workers.empty();}
+
+    void submit(std::function<void(dataIO &)> task){
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+      }
+      wake.notify_one();
+    }
+    /** \brief Drop every task not yet started */
+    void clearQueued(){
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.clear();
+    }
+};
+
+#endif
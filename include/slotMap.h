@@ -0,0 +1,103 @@
+#ifndef ____slotMap_h__
+#define ____slotMap_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/** \brief Handle to an entry in a slotMap. Stays valid until that entry is erased, and never matches an entry inserted later */
+struct slotHandle{
+  static const uint32_t nullIndex = std::numeric_limits<uint32_t>::max();
+  uint32_t index = nullIndex; /**< \brief Slot in the map */
+  uint32_t generation = 0; /**< \brief Which use of the slot this refers to */
+
+  bool isNull() const{return index == nullIndex;}
+  bool operator==(const slotHandle & other) const{return index == other.index && generation == other.generation;}
+  bool operator!=(const slotHandle & other) const{return !(*this == other);}
+};
+
+/**
+ * @brief Values in one contiguous array, reached through generational handles
+ *
+ * Values are kept packed, so a walk over them all is a walk over one array. Each handle names a slot, which holds where its value currently sits - erasing moves the last value into the gap and updates its slot. A slot's generation goes up as it is freed, so handles to erased entries find nothing rather than whatever reuses the slot.
+ * Pointers and references to values hold only until the next insert or erase - keep handles instead
+ */
+template<typename T>
+class slotMap{
+
+    struct slot{
+      uint32_t dense; /**< \brief Position of the value, while in use */
+      uint32_t generation;
+    };
+    std::vector<T> values;
+    std::vector<uint32_t> owners; /**< \brief Slot for each value */
+    std::vector<slot> slots;
+    std::vector<uint32_t> freeSlots;
+
+  public:
+    slotHandle insert(const T & value){
+      uint32_t index;
+      if(!freeSlots.empty()){
+        index = freeSlots.back();
+        freeSlots.pop_back();
+      }else{
+        index = slots.size();
+        slots.push_back({0, 0});
+      }
+      slots[index].dense = values.size();
+      values.push_back(value);
+      owners.push_back(index);
+      return {index, slots[index].generation};
+    }
+    /** \brief Remove an entry. Returns false if the handle is stale */
+    bool erase(slotHandle handle){
+      if(!contains(handle)) return false;
+      uint32_t gap = slots[handle.index].dense;
+      if(gap + 1 != values.size()){
+        values[gap] = std::move(values.back());
+        owners[gap] = owners.back();
+        slots[owners[gap]].dense = gap;
+      }
+      values.pop_back();
+      owners.pop_back();
+      slots[handle.index].generation++;
+      freeSlots.push_back(handle.index);
+      return true;
+    }
+
+    bool contains(slotHandle handle) const{
+      return handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+    }
+    /** \brief The value for handle, or nullptr if it is stale */
+    T * get(slotHandle handle){return contains(handle) ? &values[slots[handle.index].dense] : nullptr;}
+    const T * get(slotHandle handle) const{return contains(handle) ? &values[slots[handle.index].dense] : nullptr;}
+    /** \brief Handle for the value at position i of the packed array */
+    slotHandle handleAt(size_t i) const{return {owners[i], slots[owners[i]].generation};}
+
+    size_t size() const{return values.size();}
+    bool empty() const{return values.empty();}
+    void reserve(size_t count){
+      values.reserve(count);
+      owners.reserve(count);
+      slots.reserve(count);
+    }
+    void clear(){
+      // Bump every generation, so no handle issued so far can match again
+      for(auto owner : owners){
+        slots[owner].generation++;
+        freeSlots.push_back(owner);
+      }
+      values.clear();
+      owners.clear();
+    }
+
+    /** \brief Iteration over the packed values, in no particular order */
+    typename std::vector<T>::iterator begin(){return values.begin();}
+    typename std::vector<T>::iterator end(){return values.end();}
+    typename std::vector<T>::const_iterator begin() const{return values.begin();}
+    typename std::vector<T>::const_iterator end() const{return values.end();}
+};
+
+#endif
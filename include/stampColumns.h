@@ -0,0 +1,172 @@
+#ifndef ____stampColumns_h__
+#define ____stampColumns_h__
+
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "idGenerators.h"
+#include "dataObjects.h"
+
+/**
+ * @brief Tracker entries held column-wise - times in one array, dense entity ids in another
+ *
+ * A vector of timeStamp interleaves each 8 byte time with a full uid, so a scan over times pulls every id through the cache too. Here each column is contiguous: range lookups binary search the times alone, and duration sums run as a subtract over the times then a scatter by id.
+ * Kept sorted on time, equal times in the order added. Uids are interned as they arrive, so the entity column only means anything with interner()
+ */
+class stampColumns{
+
+    std::vector<timecode> times;
+    std::vector<proIds::denseId> entities;
+    proIds::uidInterner ids;
+
+    static const size_t kernelBlock = 256; /**< \brief Deltas computed per block before scattering - small enough to stay in L1 */
+    static const size_t minParallelChunk = 65536; /**< \brief Fewest intervals worth handing to a thread */
+
+    /** \brief Credit the intervals opened by stamps [from, to-1) - i.e. up to the stamp at to-1 - into totals and credited */
+    void creditSlice(size_t from, size_t to, timecode * totals, char * credited) const{
+        if(to <= from + 1) return;
+        creditIntervals(times.data() + from, entities.data() + from, to - from, totals);
+        if(credited) for(size_t i = from; i + 1 < to; i++) credited[entities[i]] = 1;
+    }
+    /**
+     * @brief As creditSlice, split across up to threads threads
+     *
+     * Each thread takes a run of stamps plus the first stamp of the next run, so the interval crossing each boundary is credited once, to the stamp which opened it. Each sums into its own table, and the tables are added in order after. Sums are integer, so the result is identical to the single-threaded one.
+     * Threads are started per call, so this only pays with idle cores to run them on - see the bench's stampColumns_durations_Nt stages
+     */
+    void creditSliceParallel(size_t from, size_t to, timecode * totals, char * credited, size_t threads) const{
+        size_t intervals = to > from ? to - from - 1 : 0;
+        size_t chunks = std::min(threads, intervals / minParallelChunk);
+        if(chunks <= 1){
+            creditSlice(from, to, totals, credited);
+            return;
+        }
+        size_t width = ids.size();
+        std::vector<std::vector<timecode>> partTotals(chunks, std::vector<timecode>(width, 0));
+        std::vector<std::vector<char>> partCredited(credited ? chunks : 0, std::vector<char>(width, 0));
+        std::vector<std::thread> workers;
+        for(size_t c = 0; c < chunks; c++){
+            size_t a = from + intervals * c / chunks, b = from + intervals * (c + 1) / chunks + 1; // Shares stamp b-1 with the next chunk
+            char * flags = credited ? partCredited[c].data() : nullptr;
+            workers.emplace_back([this, a, b, &partTotals, flags, c](){creditSlice(a, b, partTotals[c].data(), flags);});
+        }
+        for(auto & w : workers) w.join();
+        for(size_t c = 0; c < chunks; c++){
+            for(size_t i = 0; i < width; i++) totals[i] += partTotals[c][i];
+            if(credited) for(size_t i = 0; i < width; i++) credited[i] |= partCredited[c][i];
+        }
+    }
+
+  public:
+    stampColumns(){}
+    /** \brief Columns for a list of stamps. Sorts on time if they are not already */
+    explicit stampColumns(const std::vector<timeStamp> & data){
+        reserve(data.size());
+        if(std::is_sorted(data.begin(), data.end())){
+            for(auto & stamp : data) append(stamp);
+        }else{
+            auto sorted = data;
+            std::stable_sort(sorted.begin(), sorted.end());
+            for(auto & stamp : sorted) append(stamp);
+        }
+    }
+
+    void reserve(size_t count){
+        times.reserve(count);
+        entities.reserve(count);
+    }
+    /** \brief Add a stamp. In time order this is amortised O(1); an older stamp is inserted at its place, O(n) */
+    void append(const timeStamp & stamp){
+        auto id = ids.intern(stamp.projectUid);
+        if(times.empty() || stamp.time >= times.back()){
+            times.push_back(stamp.time);
+            entities.push_back(id);
+        }else{
+            size_t at = upperIndex(stamp.time);
+            times.insert(times.begin() + at, stamp.time);
+            entities.insert(entities.begin() + at, id);
+        }
+    }
+
+    size_t size() const{return times.size();}
+    bool empty() const{return times.empty();}
+    timeStamp at(size_t i) const{return {times[i], ids.uid(entities[i])};}
+    const std::vector<timecode> & timeColumn() const{return times;}
+    const std::vector<proIds::denseId> & entityColumn() const{return entities;}
+    const proIds::uidInterner & interner() const{return ids;}
+
+    /** \brief The stamp in force at t - the latest at or before it - or {timecodeNull, NullUid} if none is that early */
+    timeStamp activeAt(timecode t) const{
+        size_t after = upperIndex(t);
+        if(after == 0) return {timecodeNull, proIds::NullUid};
+        return at(after - 1);
+    }
+
+    /** \brief Index of the first stamp at or after t */
+    size_t lowerIndex(timecode t) const{return std::lower_bound(times.begin(), times.end(), t) - times.begin();}
+    /** \brief Index of the first stamp after t */
+    size_t upperIndex(timecode t) const{return std::upper_bound(times.begin(), times.end(), t) - times.begin();}
+
+    /**
+     * @brief Credit each interval [t[i], t[i+1]) for i < n-1 to id[i], adding into totals
+     *
+     * The subtract runs over a block of times with no dependence between lanes, so the compiler vectorises it; the scatter then adds each delta to its entity. totals must have an entry for every id present
+     */
+    static void creditIntervals(const timecode * t, const proIds::denseId * id, size_t n, timecode * totals){
+        timecode deltas[kernelBlock];
+        for(size_t base = 0; base + 1 < n; base += kernelBlock){
+            size_t count = std::min(kernelBlock, n - 1 - base);
+            const timecode * tb = t + base;
+            for(size_t i = 0; i < count; i++) deltas[i] = tb[i + 1] - tb[i];
+            const proIds::denseId * ib = id + base;
+            for(size_t i = 0; i < count; i++) totals[ib[i]] += deltas[i];
+        }
+    }
+
+    /**
+     * @brief Durations indexed by dense id, with the same crediting and clipping as durationAccumulator
+     *
+     * Time from start to the first stamp in range goes to whatever was running at start (untracked if nothing was). With an end the last interval is closed there. Both bounds are found by binary search, so the work is proportional to the stamps in range
+     * @param credited If given, set to flag which ids had any interval, even of zero length
+     * @param threads Most threads to sum on. Ranges are only split into chunks of at least minParallelChunk stamps, so short ones stay on the calling thread. Leave at 1 unless there are cores to spare
+     */
+    std::vector<timecode> durations(timecode start=-1, timecode end=-1, std::vector<char> * credited=nullptr, size_t threads=1) const{
+        std::vector<timecode> ret(ids.size(), 0);
+        if(credited) credited->assign(ids.size(), 0);
+        auto credit = [&](proIds::denseId id, timecode secs){
+            ret[id] += secs;
+            if(credited) (*credited)[id] = 1;
+        };
+        size_t from = start != -1 ? lowerIndex(start) : 0;
+        size_t to = end != -1 ? upperIndex(end) : times.size();
+        if(start != -1 && end != -1 && end < start) to = from; // Empty window - only the running entity matters
+        if(to < from) to = from;
+
+        proIds::denseId runningAtStart = (start != -1 && from > 0) ? entities[from - 1] : proIds::nullDenseId;
+        if(start != -1 && from < to) credit(runningAtStart, times[from] - start);
+        creditSliceParallel(from, to, ret.data(), credited ? credited->data() : nullptr, threads);
+        if(end != -1){
+            // Close the last interval at end - the open one, or the one cut by a later stamp
+            timecode last = from < to ? times[to - 1] : (start != -1 ? start : timecodeNull);
+            proIds::denseId running = from < to ? entities[to - 1] : (from > 0 ? entities[from - 1] : proIds::nullDenseId);
+            bool cutByLater = to < times.size();
+            if(last != timecodeNull && (end > last || (cutByLater && end >= last))) credit(running, end - last);
+        }
+        return ret;
+    }
+
+    /** \brief Durations keyed on uid, for ids which were credited - as stampsToDurations */
+    std::map<proIds::Uuid, timecode> durationsByUid(timecode start=-1, timecode end=-1, size_t threads=1) const{
+        std::vector<char> credited;
+        auto dense = durations(start, end, &credited, threads);
+        std::map<proIds::Uuid, timecode> ret;
+        for(size_t i = 0; i < dense.size(); i++){
+            if(credited[i]) ret.emplace_hint(ret.end(), ids.uid(i), dense[i]);
+        }
+        return ret;
+    }
+};
+
+#endif
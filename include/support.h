@@ -38,12 +38,38 @@ namespace dateLimits{
 
 enum class dataBackendType{
   flatfile, /**< \brief Flat file data backend */
-  database /**< \brief Database data backend */
+  database, /**< \brief Database data backend */
+  memory /**< \brief Held in memory only, nothing saved - for tests, benchmarks and one-off reports */
+};
+
+enum class journalMode{
+  rollback, /**< \brief SQLite default rollback journal */
+  wal /**< \brief Write-ahead log - readers do not block the writer, one fsync per commit not per page */
+};
+
+enum class syncLevel{
+  off, /**< \brief Never fsync - an OS crash may lose or corrupt recent data */
+  normal, /**< \brief fsync at checkpoints - with WAL a power cut may lose the last commits but not corrupt */
+  full /**< \brief fsync on every commit */
+};
+
+/** \brief How hard the data backend works to get each write onto disk
+*
+* Group commit batches tracker entries into one transaction, committed once it holds groupCommitSize writes, once it is older than groupCommitWindowMs, or on an explicit flush. A size of 1 commits every write immediately
+*/
+struct durabilityConfig{
+  journalMode journal = journalMode::wal;
+  syncLevel sync = syncLevel::normal;
+  int groupCommitSize = 1; /**< \brief Max tracker entries per transaction */
+  int groupCommitWindowMs = 1000; /**< \brief Max age of an open batch */
 };
 
 struct appConfig{
   std::string dataFileName = "";
   dataBackendType backend = dataBackendType::database; /**< \brief Type of data backend to use */
+  durabilityConfig durability; /**< \brief Journal, sync and batching settings for the backend */
+  bool asyncWrites = false; /**< \brief Do backend writes on a background thread */
+  bool rebuildDigests = false; /**< \brief Recompute the daily digests from the tracker entries on startup */
 };
 
 inline std::string displayFloat(float value, int dp=2){
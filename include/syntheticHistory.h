@@ -0,0 +1,112 @@
+#ifndef ____syntheticHistory__
+#define ____syntheticHistory__
+
+#include <random>
+#include <vector>
+
+#include "dataObjects.h"
+#include "dataInterface.h"
+#include "idGenerators.h"
+#include "timeWrapper.h"
+
+/** \brief Shape of a generated history */
+struct syntheticHistoryConfig{
+  int projects = 10;
+  int subsPerProject = 3;
+  int years = 1;
+  int switchesPerDay = 8; /**< \brief Project changes in a working day */
+  double pauseChance = 0.2; /**< \brief Chance each switch is followed by a pause */
+  double oneOffChance = 0.05; /**< \brief Chance each switch goes to a new one-off instead */
+  unsigned seed = 12345;
+  timecode firstDay = 1420416000; /**< \brief Any time on the first day. Default is Monday 5th January 2015 */
+};
+
+/** \brief Counts of what a generated history wrote */
+struct syntheticHistoryCounts{
+  size_t projects = 0, subprojects = 0, oneoffs = 0, stamps = 0;
+};
+
+/**
+ * @brief Writes a deterministic, plausible history into any data handler
+ *
+ * Weekdays run from 09:00 to 17:30 local time, split into switchesPerDay blocks on randomly chosen projects or subprojects, with occasional pauses and one-offs, and a stop at the end of each day. Ids come from the same seeded generator, so the same config gives the same data on every run and backend.
+ * The history always ends with a stop, so loading it does not place a new mark
+ */
+class syntheticHistory{
+
+  std::mt19937_64 rng;
+
+  proIds::Uuid nextId(proIds::uidTag tag=proIds::uidTag::none){
+    unsigned char bytes[16];
+    for(int i = 0; i < 16; i += 8){
+      auto r = rng();
+      for(int k = 0; k < 8; k++) bytes[i + k] = (r >> (8 * k)) & 0xFF;
+    }
+    bytes[6] = (bytes[6] & 0x0F) | 0x40; // Version 4 and RFC 4122 variant bits, as a real random uuid
+    bytes[8] = (bytes[8] & 0x3F) | 0x80;
+    proIds::Uuid id(bytes, 16);
+    id.tag(tag);
+    return id;
+  }
+  double uniform(){return std::uniform_real_distribution<double>(0.0, 1.0)(rng);}
+  size_t pick(size_t n){return std::uniform_int_distribution<size_t>(0, n - 1)(rng);}
+
+  public:
+    syntheticHistoryCounts generate(const syntheticHistoryConfig & config, dataIO & io){
+      rng.seed(config.seed);
+      syntheticHistoryCounts counts;
+
+      std::vector<proIds::Uuid> trackable; // Projects and subprojects - time goes on either
+      for(int p = 0; p < config.projects; p++){
+        fullProjectData proj(nextId(), projectData{"Project " + std::to_string(p), 1.0f / config.projects, timecodeNull, timecodeNull, false, false});
+        io.writeProject(proj);
+        trackable.push_back(proj.uid);
+        counts.projects++;
+        for(int s = 0; s < config.subsPerProject; s++){
+          fullSubProjectData sub(nextId(proIds::uidTag::sub), subProjectData{"Sub " + std::to_string(s), 1.0f / (config.subsPerProject + 1)}, proj.uid);
+          io.writeSubproject(sub);
+          trackable.push_back(sub.uid);
+          counts.subprojects++;
+        }
+      }
+
+      const timecode dayOpen = 9 * timeFactors::hour, dayLength = 8 * timeFactors::hour + 30 * timeFactors::minute;
+      const int switches = config.switchesPerDay > 0 ? config.switchesPerDay : 1;
+      const timecode block = dayLength / switches;
+      timecode day = timeWrapper::dayStartSeconds(config.firstDay);
+      // Weekday of the first day, from its local date
+      std::time_t first = day;
+      std::tm firstInfo = {};
+      localtime_r(&first, &firstInfo);
+      int weekday = firstInfo.tm_wday;
+
+      for(int d = 0; d < config.years * 365; d++, weekday = (weekday + 1) % 7, day = timeWrapper::nextDayStartSeconds(day)){
+        if(weekday == 0 || weekday == 6) continue;
+        timecode t = day + dayOpen;
+        for(int s = 0; s < switches; s++, t += block){
+          proIds::Uuid target;
+          if(uniform() < config.oneOffChance){
+            target = nextId(proIds::uidTag::oneoff);
+            io.writeOneOffProject({target, "One off " + std::to_string(counts.oneoffs), "Generated"});
+            counts.oneoffs++;
+          }else{
+            target = trackable[pick(trackable.size())];
+          }
+          io.writeTrackerEntry({t, target});
+          counts.stamps++;
+          if(uniform() < config.pauseChance){
+            timecode pauseAt = t + block / 2;
+            io.writeTrackerEntry({pauseAt, proIds::NullUid});
+            io.writeTrackerEntry({pauseAt + block / 4, target});
+            counts.stamps += 2;
+          }
+        }
+        io.writeTrackerEntry({day + dayOpen + dayLength, proIds::NullUid}); // Stop for the day
+        counts.stamps++;
+      }
+      io.flush();
+      return counts;
+    }
+};
+
+#endif
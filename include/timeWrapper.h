@@ -1,26 +1,176 @@
 #ifndef ____timeWrapper__
 #define ____timeWrapper__
 
+#include <algorithm>
 #include <chrono>
 #include <ctime> // Still need some C-style stuff for dates
 #include <iomanip>
 #include <sstream>
+#include <string>
+#include <vector>
 
 
 using TW_clock = std::chrono::system_clock; /**< \brief Type of clock used for time operations */
 using TW_timePoint = std::chrono::time_point<TW_clock>; /**< \brief Type of time point used in the application */
 using TW_duration = std::chrono::duration<long long>; /**< \brief Type of duration used for time calculations */
 
+/** \brief Local time's offset from UTC, remembered as runs of constant offset
+ *
+ * Asking libc costs a localtime_r per time; offsets only change at DST transitions, a few times a year. On a miss the run around the time is found - probing a week either side, and bisecting to the second where the offset changes - and kept, so later times nearby are a lookup. Assumes no two transitions within a week of each other, true of every current zone.
+ * One per thread (see timeWrapper::zoneCache), so needs no locking. Call clear if the process time zone changes
+ */
+class localOffsetCache{
+    struct run{
+      long long from, to; /**< \brief [from, to) in UTC seconds */
+      long long offset; /**< \brief Seconds east of UTC */
+    };
+    std::vector<run> runs; /**< \brief Sorted, not overlapping */
+    size_t lastHit = 0;
+
+    static const long long probe = 7 * 24 * 3600;
+
+    static long long libcOffset(long long t){
+      std::time_t theTime = t;
+      std::tm timeInfo = {};
+      localtime_r(&theTime, &timeInfo);
+      return timeInfo.tm_gmtoff;
+    }
+    /** \brief First time in (a, b] with a different offset to a, given b has one */
+    static long long transition(long long a, long long b){
+      long long offA = libcOffset(a);
+      while(b - a > 1){
+        long long mid = a + (b - a) / 2;
+        if(libcOffset(mid) == offA) a = mid; else b = mid;
+      }
+      return b;
+    }
+
+  public:
+    long long offset(long long t){
+      if(lastHit < runs.size() && t >= runs[lastHit].from && t < runs[lastHit].to) return runs[lastHit].offset;
+      auto it = std::upper_bound(runs.begin(), runs.end(), t, [](long long v, const run & r){return v < r.from;});
+      if(it != runs.begin() && t < (it - 1)->to){
+        lastHit = it - 1 - runs.begin();
+        return runs[lastHit].offset;
+      }
+
+      // Miss - find the run around t, then trim it to the gap between its cached neighbours
+      long long off = libcOffset(t);
+      long long hi = t + probe, lo = t - probe;
+      if(libcOffset(hi) != off) hi = transition(t, hi);
+      if(libcOffset(lo) != off) lo = transition(lo, t);
+      if(it != runs.begin()) lo = std::max(lo, (it - 1)->to);
+      if(it != runs.end()) hi = std::min(hi, it->from);
+      it = runs.insert(it, {lo, hi, off});
+      lastHit = it - runs.begin();
+      return off;
+    }
+    void clear(){
+      runs.clear();
+      lastHit = 0;
+    }
+};
+
 /** \brief A wrapper for time operations
  * 
- * Provides a consistent interface for getting the current time, formatting it, and converting between different time representations. STATELESS. Allows the rest of the app to use time without worrying about the underlying implementation.
+ * Provides a consistent interface for getting the current time, formatting it, and converting between different time representations. STATELESS, apart from a per-thread cache of UTC offsets. Allows the rest of the app to use time without worrying about the underlying implementation.
  */
 class timeWrapper{
+    /** \brief Local y-m-d h:m:s, as from localtime */
+    struct civilTime{
+      long long year;
+      int month, day, hour, minute, second;
+    };
+
+    /** \brief Days since 1970-01-01 to proleptic Gregorian date. Out of range days and months roll over, as mktime */
+    static long long daysFromCivil(long long y, long long m, long long d){
+      y += (m - 1 >= 0 ? (m - 1) / 12 : (m - 12) / 12);
+      m = ((m - 1) % 12 + 12) % 12 + 1;
+      y -= m <= 2;
+      long long era = (y >= 0 ? y : y - 399) / 400;
+      long long yoe = y - era * 400;
+      long long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+      long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+      return era * 146097 + doe - 719468;
+    }
+    /** \brief Local date and time for UTC seconds, using the cached offset */
+    static civilTime toCivil(long long seconds){
+      long long local = seconds + zoneCache().offset(seconds);
+      long long days = local >= 0 ? local / 86400 : (local - 86399) / 86400;
+      long long secs = local - days * 86400;
+      // Inverse of daysFromCivil
+      long long z = days + 719468;
+      long long era = (z >= 0 ? z : z - 146096) / 146097;
+      long long doe = z - era * 146097;
+      long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+      long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+      long long mp = (5 * doy + 2) / 153;
+      civilTime ret;
+      ret.day = doy - (153 * mp + 2) / 5 + 1;
+      ret.month = mp < 10 ? mp + 3 : mp - 9;
+      ret.year = yoe + era * 400 + (ret.month <= 2);
+      ret.hour = secs / 3600;
+      ret.minute = secs % 3600 / 60;
+      ret.second = secs % 60;
+      return ret;
+    }
+    static char * put2(char * out, int v){
+      out[0] = '0' + v / 10;
+      out[1] = '0' + v % 10;
+      return out + 2;
+    }
+    /** \brief Parse exactly n digits, or return -1 */
+    static int digits(const char * in, int n){
+      int v = 0;
+      for(int i = 0; i < n; i++){
+        if(in[i] < '0' || in[i] > '9') return -1;
+        v = v * 10 + (in[i] - '0');
+      }
+      return v;
+    }
+    static TW_timePoint parseTimeZonedLibc(const std::string &timeStr) {
+      std::tm tm = {};
+      std::istringstream ss(timeStr);
+      ss >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
+      if (ss.fail()) {
+        throw std::runtime_error("Failed to parse time string: " + timeStr);
+      }
+      tm.tm_isdst = -1; //TODO - try and verify that this works?
+      return TW_clock::from_time_t(std::mktime(&tm));
+    }
+
+    enum class startOf{day, week, month};
+    /**
+     * @brief Local midnight starting the day, week or month containing the given time, moved on by days and months
+     *
+     * mktime normalises any rollover, and with tm_isdst unset works out DST for the new date rather than keeping the old one
+     */
+    static long long localMidnightSeconds(long long seconds, startOf from, int days=0, int months=0){
+      std::time_t theTime = seconds;
+      std::tm timeInfo = {};
+      localtime_r(&theTime, &timeInfo);
+      if(from == startOf::week) timeInfo.tm_mday -= (timeInfo.tm_wday + 6) % 7; // Days since Monday
+      if(from == startOf::month) timeInfo.tm_mday = 1;
+      timeInfo.tm_mday += days;
+      timeInfo.tm_mon += months;
+      timeInfo.tm_hour = 0;
+      timeInfo.tm_min = 0;
+      timeInfo.tm_sec = 0;
+      timeInfo.tm_isdst = -1;
+      return std::mktime(&timeInfo);
+    }
+
   public:
     using clock = TW_clock;
     using timePoint = TW_timePoint;
     using duration = TW_duration;
 
+    /** \brief This thread's cache of UTC offsets, used for formatting and parsing. Clear it if the time zone is changed while running */
+    static localOffsetCache & zoneCache(){
+      thread_local localOffsetCache cache;
+      return cache;
+    }
+
     static timePoint now() {
       return clock::now(); /**< \brief Get the current time point */
     }
@@ -36,17 +186,50 @@ class timeWrapper{
     static timePoint referenceTime() {
       return clock::from_time_t(0); /**< \brief Get the reference time (epoch) */
     }
+    /** \brief Length of formatSecondsTo's output */
+    static const size_t formattedLength = 19;
+    /** \brief Write local time as "YYYY-MM-DD HH:MM:SS" to out, which must have room for formattedLength chars. No terminator
+     *
+     * The digits are written directly, with the offset from the zone cache - no libc call once the cache is warm, and safe on any thread. For bulk output such as exports. Years outside 0-9999 are clamped to 4 digits, so use formatTime for those
+     */
+    static void formatSecondsTo(long long seconds, char * out){
+      civilTime c = toCivil(seconds);
+      int y = c.year < 0 ? 0 : (c.year > 9999 ? 9999 : c.year);
+      out = put2(out, y / 100);
+      out = put2(out, y % 100);
+      *out++ = '-';
+      out = put2(out, c.month);
+      *out++ = '-';
+      out = put2(out, c.day);
+      *out++ = ' ';
+      out = put2(out, c.hour);
+      *out++ = ':';
+      out = put2(out, c.minute);
+      *out++ = ':';
+      put2(out, c.second);
+    }
     static std::string formatTime(timePoint tp) {
-      std::time_t time = clock::to_time_t(tp); /**< \brief Convert time point to time_t for formatting */
-      char buffer[100];
-      std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", std::localtime(&time)); /**< \brief Format time as a string */
-      return std::string(buffer);
+      long long seconds = toSeconds(tp);
+      civilTime c = toCivil(seconds);
+      if(c.year < 0 || c.year > 9999){
+        std::time_t time = seconds;
+        std::tm timeInfo = {};
+        localtime_r(&time, &timeInfo);
+        char buffer[100];
+        std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &timeInfo);
+        return std::string(buffer);
+      }
+      char buffer[formattedLength];
+      formatSecondsTo(seconds, buffer);
+      return std::string(buffer, formattedLength);
     }
     static std::string formatTimeAsClock(timePoint tp) {
-      std::time_t time = clock::to_time_t(tp); /**< \brief Convert time point to time_t for formatting */
-      char buffer[100];
-      std::strftime(buffer, sizeof(buffer), "%H:%M", std::localtime(&time)); /**< \brief Format time as a string */
-      return std::string(buffer);
+      civilTime c = toCivil(toSeconds(tp));
+      char buffer[5];
+      put2(buffer, c.hour);
+      buffer[2] = ':';
+      put2(buffer + 3, c.minute);
+      return std::string(buffer, 5);
     }
     static timePoint parseTime(const std::string &timeStr) {
       //Assumes string is GMT, does not attempt to parse any zoning
@@ -60,37 +243,45 @@ class timeWrapper{
     }
     static timePoint parseTimeZoned(const std::string &timeStr) {
       //Parse the time string correctly as clock time in current time zone
-      std::tm tm = {};
-      std::istringstream ss(timeStr);
-      ss >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
-      if (ss.fail()) {
-        throw std::runtime_error("Failed to parse time string: " + timeStr);
+      // Fast path for exactly "YYYY-MM-DD HH:MM:SS". Anything looser, or a time near a DST change (where mktime has to choose), goes through libc
+      const char * in = timeStr.c_str();
+      if(timeStr.size() == formattedLength && in[4] == '-' && in[7] == '-' && in[10] == ' ' && in[13] == ':' && in[16] == ':'){
+        int y = digits(in, 4), mo = digits(in + 5, 2), d = digits(in + 8, 2), h = digits(in + 11, 2), mi = digits(in + 14, 2), sec = digits(in + 17, 2);
+        if(y >= 0 && mo >= 1 && mo <= 12 && d >= 1 && d <= 31 && h >= 0 && h <= 23 && mi >= 0 && mi <= 59 && sec >= 0 && sec <= 59){
+          long long local = daysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec;
+          auto & zone = zoneCache();
+          long long guess = local - zone.offset(local);
+          long long offBefore = zone.offset(guess - 86400), offAfter = zone.offset(guess + 86400);
+          if(offBefore == offAfter && zone.offset(local - offBefore) == offBefore) return fromSeconds(local - offBefore);
+        }
       }
-      tm.tm_isdst = -1; //TODO - try and verify that this works?
-      return clock::from_time_t(std::mktime(&tm));
+      return parseTimeZonedLibc(timeStr);
     }
 
     // Get the time which is the midnight (start of day) containing the given time
     static timePoint midnightBefore(timePoint tp){
-      std::time_t theTime = clock::to_time_t(tp);
-      auto timeInfo = localtime(&theTime);
-      std::cout<<timeInfo->tm_hour<<" "<<timeInfo->tm_min<<std::endl;
-      timeInfo->tm_hour = 0;
-      timeInfo->tm_min = 0;
-      timeInfo->tm_sec = 0;
-      return clock::from_time_t(mktime(timeInfo));
+      return fromSeconds(dayStartSeconds(toSeconds(tp)));
     }
     static timePoint startOfMonth(timePoint tp){
-      std::time_t theTime = clock::to_time_t(tp);
-      auto timeInfo = localtime(&theTime);
-      std::cout<<timeInfo->tm_hour<<" "<<timeInfo->tm_min<<std::endl;
-      timeInfo->tm_mday = 1;
-      timeInfo->tm_hour = 0;
-      timeInfo->tm_min = 0;
-      timeInfo->tm_sec = 0;
-      return clock::from_time_t(mktime(timeInfo));
+      return fromSeconds(monthStartSeconds(toSeconds(tp)));
     }
 
+    /** \brief Local midnight on or before the given time, in seconds since epoch
+     *
+     * Uses the reentrant localtime_r, so safe off the GUI thread. Days are not always 24 h long (DST), so step between days with nextDayStartSeconds rather than adding timeFactors::day
+     */
+    static long long dayStartSeconds(long long seconds){return localMidnightSeconds(seconds, startOf::day);}
+    /** \brief First local midnight strictly after the given time, in seconds since epoch */
+    static long long nextDayStartSeconds(long long seconds){return localMidnightSeconds(seconds, startOf::day, 1);}
+    /** \brief Local midnight starting the ISO week (Monday) containing the given time, in seconds since epoch */
+    static long long weekStartSeconds(long long seconds){return localMidnightSeconds(seconds, startOf::week);}
+    /** \brief Local midnight starting the ISO week after the one containing the given time */
+    static long long nextWeekStartSeconds(long long seconds){return localMidnightSeconds(seconds, startOf::week, 7);}
+    /** \brief Local midnight starting the month containing the given time */
+    static long long monthStartSeconds(long long seconds){return localMidnightSeconds(seconds, startOf::month);}
+    /** \brief Local midnight starting the month after the one containing the given time */
+    static long long nextMonthStartSeconds(long long seconds){return localMidnightSeconds(seconds, startOf::month, 0, 1);}
+
   };
 
 
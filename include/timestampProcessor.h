@@ -1,14 +1,260 @@
 #ifndef ____timestampProcessor_h__
 #define ____timestampProcessor_h__
 
+#include <algorithm>
+#include <thread>
 #include <vector>
 #include <map>
 
 #include "idGenerators.h"
 #include "timeWrapper.h"
 #include "dataObjects.h"
+#include "stampColumns.h"
 
 
+/** \brief Per-entity durations built up from ordered stamps, with entities as dense ids
+*
+* Each interval between consecutive stamps is credited to the stamp which OPENED it - the entity that was running. A pause or stop is a NullUid stamp, so untracked time collects under nullDenseId.
+* Stamps before start_in only update what is running; time from start_in to the first stamp in range goes to activeAtStart (untracked unless told otherwise). If end_in is given the open interval is closed there and later stamps are ignored.
+* Totals are a flat array indexed by id, so each stamp costs one add rather than a tree walk. Memory is O(entities), independent of the number of stamps
+*/
+class denseDurationAccumulator{
+    std::vector<timecode> durations; /**< \brief Indexed by dense id */
+    std::vector<char> credited; /**< \brief Whether each id has had an interval, even of zero length */
+    timecode start, end; /**< \brief Clip bounds, -1 for none */
+    timecode last = timecodeNull; /**< \brief Time the running interval opened */
+    proIds::denseId running; /**< \brief Entity credited with the running interval */
+    timecode first = timecodeNull; /**< \brief Time of first stamp seen */
+    size_t count = 0; /**< \brief Stamps seen */
+    bool finished = false; /**< \brief Passed end - ignore further stamps */
+
+    void credit(proIds::denseId id, timecode secs){
+        if(id >= durations.size()){
+            durations.resize(id + 1, 0);
+            credited.resize(id + 1, 0);
+        }
+        durations[id] += secs;
+        credited[id] = 1;
+    }
+
+  public:
+    denseDurationAccumulator(timecode start_in=-1, timecode end_in=-1, proIds::denseId activeAtStart=proIds::nullDenseId)
+        : start(start_in), end(end_in), running(activeAtStart){
+        if(start != -1) last = start;
+    }
+    /** \brief Pre-size for ids below idCount, e.g. an interner's size */
+    void reserve(size_t idCount){
+        if(idCount > durations.size()){
+            durations.resize(idCount, 0);
+            credited.resize(idCount, 0);
+        }
+    }
+
+    void add(timecode time, proIds::denseId id){
+        if(finished) return;
+        if(first == timecodeNull) first = time;
+        count++;
+        if(start != -1 && time < start){
+            running = id; // Before window - only track what is running
+            return;
+        }
+        if(end != -1 && time > end){
+            if(last != timecodeNull) credit(running, end - last);
+            finished = true;
+            return;
+        }
+        if(last != timecodeNull) credit(running, time - last);
+        last = time;
+        running = id;
+    }
+    void add(const internedStamp & stamp){add(stamp.time, stamp.id);}
+    void add(const std::vector<internedStamp> & chunk){
+        for(auto & stamp : chunk) add(stamp.time, stamp.id);
+    }
+
+    /** \brief Durations so far, indexed by dense id. With an end bound, includes the open interval up to end */
+    std::vector<timecode> result() const{
+        auto ret = durations;
+        if(!finished && end != -1 && last != timecodeNull && end > last){
+            if(running >= ret.size()) ret.resize(running + 1, 0);
+            ret[running] += (end - last);
+        }
+        return ret;
+    }
+    /** \brief Durations so far keyed on Uuid, for ids which have been credited */
+    std::map<proIds::Uuid, timecode> result(const proIds::uidInterner & ids) const{
+        std::map<proIds::Uuid, timecode> ret;
+        for(size_t i = 0; i < durations.size(); i++){
+            if(credited[i]) ret.emplace_hint(ret.end(), ids.uid(i), durations[i]);
+        }
+        if(!finished && end != -1 && last != timecodeNull && end > last) ret[ids.uid(running)] += (end - last);
+        return ret;
+    }
+    timecode firstStampTime() const{return first;}
+    size_t stampCount() const{return count;}
+};
+
+/** \brief Per-uid durations built up from ordered stamps fed one at a time or in chunks
+*
+* As denseDurationAccumulator, interning each uid as it arrives. Where the same stamps are summed more than once, intern them up front (timestampProcessor::internStamps) and use the dense accumulator directly
+*/
+class durationAccumulator{
+    proIds::uidInterner ids;
+    denseDurationAccumulator acc;
+
+  public:
+    durationAccumulator(timecode start_in=-1, timecode end_in=-1, proIds::Uuid activeAtStart=proIds::NullUid)
+        : acc(start_in, end_in, ids.intern(activeAtStart)){}
+
+    void add(const timeStamp & stamp){acc.add(stamp.time, ids.intern(stamp.projectUid));}
+    void add(const std::vector<timeStamp> & chunk){
+        for(auto & stamp : chunk) add(stamp);
+    }
+
+    /** \brief Durations so far. With an end bound, includes the open interval up to end */
+    std::map<proIds::Uuid, timecode> result() const{return acc.result(ids);}
+    timecode firstStampTime() const{return acc.firstStampTime();}
+    size_t stampCount() const{return acc.stampCount();}
+};
+
+/** \brief Splits intervals at local midnight, remembering the last day seen
+*
+* Converting to local time costs far more than the rest of the digest work, and consecutive stamps are mostly on the same day, so the bounds of the last day are kept and only recomputed when a time falls outside them
+*/
+class localDayCache{
+    timecode dayStart = 1, dayEnd = 0; /**< \brief [dayStart, dayEnd) is the cached day. Empty to start */
+    void locate(timecode t){
+        if(t >= dayStart && t < dayEnd) return;
+        dayStart = timeWrapper::dayStartSeconds(t);
+        dayEnd = timeWrapper::nextDayStartSeconds(t);
+    }
+  public:
+    /** \brief Split the interval [from, to) at local midnights, calling fn(dayStart, seconds) for each piece */
+    template<typename F>
+    void splitByDay(timecode from, timecode to, F fn){
+        while(from < to){
+            locate(from);
+            timecode pieceEnd = dayEnd < to ? dayEnd : to;
+            fn(dayStart, pieceEnd - from);
+            from = pieceEnd;
+        }
+    }
+};
+
+/** \brief Per-day, per-uid durations built up from ordered stamps
+*
+* Credits intervals the same way as durationAccumulator, but splits each one at local midnight so an interval running past midnight counts towards both days. Untracked (NullUid) time is dropped. The interval opened by the last stamp is left open.
+* The day being filled is a flat row indexed by dense id, moved into the keyed results when the day changes
+*/
+class dailyDigestAccumulator{
+    std::vector<dailyDigest> digests; /**< \brief Finished days, in (day, entity) order */
+    proIds::uidInterner ids;
+    timecode rowDay = timecodeNull; /**< \brief Day start of the row being filled */
+    std::vector<timecode> row; /**< \brief Time per dense id on rowDay */
+    std::vector<proIds::denseId> rowTouched; /**< \brief Ids with time in row */
+    timecode last = timecodeNull; /**< \brief Time the running interval opened */
+    proIds::denseId running = proIds::nullDenseId; /**< \brief Entity credited with the running interval */
+    localDayCache days;
+
+    /** \brief Append the row's digests to out, in entity order */
+    void appendRow(std::vector<dailyDigest> & out) const{
+        auto touched = rowTouched;
+        std::sort(touched.begin(), touched.end(), [this](proIds::denseId a, proIds::denseId b){return ids.uid(a) < ids.uid(b);});
+        for(auto id : touched) out.push_back({rowDay, ids.uid(id), row[id]});
+    }
+    void credit(timecode day, timecode secs){
+        if(day != rowDay){
+            // Stamps are in order, so a day once left is finished
+            appendRow(digests);
+            for(auto id : rowTouched) row[id] = 0;
+            rowTouched.clear();
+            rowDay = day;
+        }
+        if(running >= row.size()) row.resize(ids.size(), 0);
+        if(row[running] == 0) rowTouched.push_back(running); // Pieces are never empty, so zero means untouched
+        row[running] += secs;
+    }
+
+  public:
+    void add(const timeStamp & stamp){
+        if(last != timecodeNull && running != proIds::nullDenseId){
+            days.splitByDay(last, stamp.time, [this](timecode day, timecode secs){credit(day, secs);});
+        }
+        last = stamp.time;
+        running = ids.intern(stamp.projectUid);
+    }
+    void add(const std::vector<timeStamp> & chunk){
+        for(auto & stamp : chunk) add(stamp);
+    }
+
+    std::vector<dailyDigest> result() const{
+        auto ret = digests;
+        appendRow(ret);
+        return ret;
+    }
+};
+
+/** \brief Per-uid durations kept up to date as stamps are made
+*
+* Seeded once with the totals for all closed intervals and the latest stamp, then fed each new stamp. Answers "totals up to now" in O(entities) by adding the still-open interval on read. Stamps must arrive in time order - add reports one that does not, and the owner should reseed
+*/
+class runningTotals{
+    std::map<proIds::Uuid, timecode> durations; /**< \brief Closed intervals only */
+    timeStamp last{timecodeNull, proIds::NullUid}; /**< \brief Latest stamp - opened the running interval */
+    timecode first = timecodeNull; /**< \brief Time of earliest stamp */
+
+  public:
+    void seed(std::map<proIds::Uuid, timecode> closed, timeStamp latest, timecode earliest){
+        durations = std::move(closed);
+        last = latest;
+        first = earliest;
+    }
+    void clear(){seed({}, {timecodeNull, proIds::NullUid}, timecodeNull);}
+
+    /** \brief Close the running interval with a new stamp
+     *
+     * @returns False if the stamp is older than the latest one, in which case nothing is changed
+     */
+    bool add(const timeStamp & stamp){
+        if(last.time != timecodeNull){
+            if(stamp.time < last.time) return false;
+            if(last.projectUid != proIds::NullUid) durations[last.projectUid] += (stamp.time - last.time);
+        }
+        if(first == timecodeNull) first = stamp.time;
+        last = stamp;
+        return true;
+    }
+
+    /** \brief Fold in a stamp at or before the latest one, which splits a closed interval or ties the open one
+     *
+     * Stores order equal times as written, so the stamp is in force from its time until next - the time of the first entry after it, or timecodeNull if there is none. runningThen is the entry in force at its time before it was written. From time to next moves from runningThen to the stamp's entity
+     */
+    void insert(const timeStamp & stamp, const proIds::Uuid & runningThen, timecode next){
+        if(first == timecodeNull || stamp.time < first) first = stamp.time;
+        if(next == timecodeNull){
+            last = stamp; // Tied the latest - nothing closed
+            return;
+        }
+        if(stamp.projectUid == runningThen) return;
+        timecode moved = next - stamp.time;
+        if(runningThen != proIds::NullUid){
+            auto it = durations.find(runningThen);
+            if(it != durations.end() && (it->second -= moved) <= 0) durations.erase(it);
+        }
+        if(stamp.projectUid != proIds::NullUid) durations[stamp.projectUid] += moved;
+    }
+
+    /** \brief Totals including the running interval up to now. Untracked time is not included */
+    std::map<proIds::Uuid, timecode> at(timecode now) const{
+        auto ret = durations;
+        if(last.time != timecodeNull && last.projectUid != proIds::NullUid && now > last.time) ret[last.projectUid] += (now - last.time);
+        return ret;
+    }
+    bool empty() const{return last.time == timecodeNull;}
+    timecode firstStampTime() const{return first;}
+    timeStamp latest() const{return last;}
+};
+
 //Processes a list of timestamps into a per-uid list of durations
 //Ought to be stateless...
 class timestampProcessor{
@@ -32,45 +278,29 @@ class timestampProcessor{
     }
 
     static std::map<proIds::Uuid, timecode> stampsToDurations(const std::vector<timeStamp> & data, timecode start_in=-1, timecode end_in=-1){
-        //Take a list of timestamps (ordered by time) and convert to durations per Uuid
-        std::map<proIds::Uuid, timecode> durations;
-        if(data.size() == 0) return durations; // No stamps to process
-
-        timecode last, end;
+        //Take a list of timestamps and convert to durations per Uuid. Summed column-wise - see stampColumns
+        return stampColumns(data).durationsByUid(start_in, end_in);
+    }
+    /** \brief As stampsToDurations, summed on up to threads threads (0 for one per core). Results are identical; any gain depends on free cores */
+    static std::map<proIds::Uuid, timecode> stampsToDurationsParallel(const std::vector<timeStamp> & data, size_t threads=0, timecode start_in=-1, timecode end_in=-1){
+        if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        return stampColumns(data).durationsByUid(start_in, end_in, threads);
+    }
 
-        //Setup last value for previous entry
-        if(start_in != -1){
-            last = start_in;
-        }else{
-            //Start from smallest timecode
-            last = data[0].time;
-        }
-        if(end_in != -1){
-            end = end_in;
-        }else{
-            end = data[data.size()-1].time;
-        }
+    /** \brief Swap each stamp's uid for its dense id, interning any new ones */
+    static std::vector<internedStamp> internStamps(const std::vector<timeStamp> & data, proIds::uidInterner & ids){
+        std::vector<internedStamp> ret;
+        ret.reserve(data.size());
+        for(auto & stamp : data) ret.push_back({stamp.time, ids.intern(stamp.projectUid)});
+        return ret;
+    }
 
-        for(auto & stamp :data){
-            if(durations.count(stamp.projectUid) > 0){
-                if(stamp.time <= end){
-                   durations[stamp.projectUid] += (stamp.time - last);
-                   last = stamp.time;
-                }else{
-                    durations[stamp.projectUid] += (end - last);
-                    break;// Exceeding end after this
-                }
-            }else{
-                if(stamp.time <= end){
-                    durations[stamp.projectUid] = (stamp.time - last);
-                    last = stamp.time;
-                }else{
-                    durations[stamp.projectUid] = (end - last);
-                    break;// Exceeding end after this 
-                }
-            }
-        }
-        return durations;
+    /** \brief Durations indexed by dense id, for stamps interned by internStamps. Ids never credited are 0 */
+    static std::vector<timecode> stampsToDurations(const std::vector<internedStamp> & data, size_t idCount, timecode start_in=-1, timecode end_in=-1){
+        denseDurationAccumulator acc(start_in, end_in);
+        acc.reserve(idCount);
+        acc.add(data);
+        return acc.result();
     }
 
 
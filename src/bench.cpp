@@ -0,0 +1,467 @@
+#include <QApplication>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include "support.h"
+#include "dataInterface.h"
+#include "TrackerData.h"
+#include "syntheticHistory.h"
+#include "timestampProcessor.h"
+#include "stampColumns.h"
+#include "calendarBuckets.h"
+#include "durationIndex.h"
+#include "projectManager.h"
+
+/*
+Benchmarks for loading and summarising, on generated histories of several sizes, against each data backend.
+
+Usage: TTTBench [results file] [--quick]
+Results are written as CSV, one row per backend, size and stage - default bench_output.txt. --quick runs the smallest size only.
+Database and flat files are made in the working directory and removed afterwards.
+*/
+
+namespace{
+
+struct benchSize{
+  std::string name;
+  syntheticHistoryConfig config;
+};
+
+struct benchBackend{
+  std::string name;
+  dataBackendType type;
+  std::string fileName; /**< \brief Empty for memory */
+};
+
+/** \brief Run fn reps times, returning each run's duration in ms */
+std::vector<double> timeRuns(int reps, const std::function<void()> & fn){
+  std::vector<double> times;
+  for(int i = 0; i < reps; i++){
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  return times;
+}
+
+class resultWriter{
+  std::ofstream out;
+  public:
+    resultWriter(const std::string & fileName) : out(fileName){
+      if(!out) throw std::runtime_error("Cannot open results file " + fileName);
+      out << "backend,size,projects,subprojects,oneoffs,stamps,stage,reps,median_ms,min_ms\n";
+    }
+    void record(const benchBackend & backend, const benchSize & size, const syntheticHistoryCounts & counts, const std::string & stage, std::vector<double> times){
+      std::sort(times.begin(), times.end());
+      double median = times[times.size() / 2];
+      out << backend.name << ',' << size.name << ',' << counts.projects << ',' << counts.subprojects << ',' << counts.oneoffs << ',' << counts.stamps << ',';
+      out << stage << ',' << times.size() << ',' << median << ',' << times.front() << '\n';
+      std::cerr << backend.name << " " << size.name << " (" << counts.stamps << " stamps) " << stage << ": " << median << " ms" << std::endl;
+    }
+};
+
+void removeFiles(const benchBackend & backend){
+  for(auto ext : {"", "-wal", "-shm", ".stamps", ".entities", ".late"}) std::remove((backend.fileName + ext).c_str());
+}
+
+dataIO * openBackend(const benchBackend & backend){
+  durabilityConfig dur;
+  dur.sync = syncLevel::off; // Measure the code, not the disk
+  dur.groupCommitSize = 1000;
+  if(backend.type == dataBackendType::database) return new databaseIO(backend.fileName, dur);
+  if(backend.type == dataBackendType::flatfile) return new flatfileIO(backend.fileName, dur);
+  return new memoryIO();
+}
+
+/**
+ * @brief Hold every backend to one order for stamps in the same second - the order written
+ *
+ * A start then a stop in one second must read back as stopped, and a switch as the later project, both live and, for files, after reopening. Throws on any difference
+ */
+void checkSameSecondOrder(const benchBackend & backend){
+  removeFiles(backend);
+  uniqueIdGenerator gen;
+  proIds::Uuid a = gen.getNextId(), b = gen.getNextId();
+  timecode base = syntheticHistoryConfig().firstDay;
+  std::vector<timeStamp> written = {{base, a}, {base + 1000, a}, {base + 1000, proIds::NullUid}, {base + 2000, a}, {base + 3000, a}, {base + 3000, b}, {base + 4000, proIds::NullUid}};
+  auto check = [&](TrackerData & data, dataIO & io, const std::string & when){
+    auto fail = [&](const std::string & what){throw std::runtime_error(backend.name + " " + when + ": " + what);};
+    auto stamps = io.fetchTrackerEntries();
+    if(stamps.size() != written.size()) fail("wrong number of tracker entries");
+    for(size_t i = 0; i < stamps.size(); i++){
+      if(stamps[i].time != written[i].time || stamps[i].projectUid != written[i].projectUid) fail("same-second entries out of write order");
+    }
+    if(data.activeAt(base + 1000).projectUid != proIds::NullUid) fail("start then stop in one second reads as running");
+    if(data.activeAt(base + 3000).projectUid != b) fail("switch in one second reads as the earlier project");
+    if(io.fetchLatestTrackerEntry().projectUid != proIds::NullUid) fail("latest entry is not the stop");
+    auto durations = timestampProcessor::stampsToDurations(stamps);
+    if(durations[a] != 2000 || durations[b] != 1000) fail("durations credited across a same-second stop or switch");
+  };
+  {
+    dataIO * io = openBackend(backend);
+    TrackerData data(io);
+    data.loadProjects(base);
+    for(auto & stamp : written){
+      if(stamp.projectUid == proIds::NullUid){
+        data.stopProject(stamp.time);
+      }else{
+        data.markProject(stamp.projectUid, "", stamp.time);
+      }
+    }
+    data.flushPendingWrites();
+    check(data, *io, "as written");
+  }
+  if(backend.type != dataBackendType::memory){
+    dataIO * io = openBackend(backend);
+    TrackerData data(io);
+    data.loadProjects(base + 5000); // Would mark a project still running - it must not think one is
+    check(data, *io, "reopened");
+  }
+  removeFiles(backend);
+}
+
+void runOne(const benchBackend & backend, const benchSize & size, resultWriter & results, int reps){
+  removeFiles(backend);
+  syntheticHistoryCounts counts;
+  syntheticHistory gen;
+
+  // Memory keeps nothing between handlers, so each run has to fill its own. Files are filled once and reopened
+  std::function<dataIO *()> freshHandler;
+  std::vector<double> writeTime;
+  if(backend.type == dataBackendType::memory){
+    freshHandler = [&](){
+      auto io = new memoryIO();
+      io->reserveTrackerEntries(counts.stamps);
+      gen.generate(size.config, *io);
+      return io;
+    };
+    writeTime = timeRuns(1, [&](){
+      memoryIO io;
+      counts = gen.generate(size.config, io);
+    });
+  }else{
+    writeTime = timeRuns(1, [&](){
+      std::unique_ptr<dataIO> io(openBackend(backend));
+      counts = gen.generate(size.config, *io);
+    });
+    freshHandler = [&](){return openBackend(backend);};
+    results.record(backend, size, counts, "open", timeRuns(reps, [&](){delete freshHandler();}));
+  }
+  if(backend.type == dataBackendType::database){
+    // Plans depend on the data, so are checked here against a full database
+    databaseIO db(backend.fileName);
+    if(!db.checkQueryPlans()) throw std::runtime_error("Tracker queries not index-backed on " + size.name + " database");
+  }
+  results.record(backend, size, counts, "write", writeTime);
+
+  // Loading - a fresh TrackerData each run, as the app does on start
+  std::vector<double> loadTimes;
+  for(int i = 0; i < reps; i++){
+    TrackerData data(freshHandler());
+    loadTimes.push_back(timeRuns(1, [&](){data.loadProjects(timeWrapper::toSeconds(timeWrapper::now()));})[0]);
+  }
+  results.record(backend, size, counts, "loadProjects", loadTimes);
+
+  std::unique_ptr<dataIO> io(freshHandler());
+  std::vector<timeStamp> stamps;
+  results.record(backend, size, counts, "fetchTrackerEntries", timeRuns(reps, [&](){stamps = io->fetchTrackerEntries();}));
+  timecode last = stamps.size() > 0 ? stamps.back().time : 0;
+  results.record(backend, size, counts, "fetchTrackerEntries_30d", timeRuns(reps, [&](){io->fetchTrackerEntries(last - 30 * timeFactors::day, last);}));
+  results.record(backend, size, counts, "streamTrackerEntries", timeRuns(reps, [&](){
+    durationAccumulator acc;
+    io->streamTrackerEntries([&acc](const std::vector<timeStamp> & chunk){acc.add(chunk);});
+  }));
+  results.record(backend, size, counts, "stampsToDurations", timeRuns(reps, [&](){timestampProcessor::stampsToDurations(stamps);}));
+  // Row-wise accumulator against the columns, whole history and last 30 days
+  results.record(backend, size, counts, "durationAccumulator", timeRuns(reps, [&](){
+    durationAccumulator acc;
+    acc.add(stamps);
+    acc.result();
+  }));
+  results.record(backend, size, counts, "durationAccumulator_30d", timeRuns(reps, [&](){
+    durationAccumulator acc(last - 30 * timeFactors::day, last);
+    acc.add(stamps);
+    acc.result();
+  }));
+  stampColumns columns;
+  results.record(backend, size, counts, "stampColumns_build", timeRuns(reps, [&](){columns = stampColumns(stamps);}));
+  results.record(backend, size, counts, "stampColumns_durations", timeRuns(reps, [&](){columns.durations();}));
+  results.record(backend, size, counts, "stampColumns_durations_30d", timeRuns(reps, [&](){columns.durations(last - 30 * timeFactors::day, last);}));
+  results.record(backend, size, counts, "fetchDailyDigests", timeRuns(reps, [&](){io->fetchDailyDigests();}));
+  durationIndex index;
+  results.record(backend, size, counts, "durationIndex_build", timeRuns(reps, [&](){index.build(stamps);}));
+  results.record(backend, size, counts, "durationIndex_30d", timeRuns(reps, [&](){index.durationsBetween(last - 30 * timeFactors::day, last);}));
+  if(stamps.size() > 0){
+    results.record(backend, size, counts, "calendarBreakdown_week", timeRuns(reps, [&](){
+      calendarBucketer buckets(calendarUnit::week, stamps.front().time, last + 1);
+      buckets.add(stamps);
+      buckets.result();
+    }));
+  }
+  io.reset();
+
+  // Summaries are cached until the data changes, so after the first run these time a re-request in another unit
+  TrackerData data(freshHandler());
+  data.loadProjects(timeWrapper::toSeconds(timeWrapper::now()));
+  results.record(backend, size, counts, "generateTimeSummary", timeRuns(reps, [&](){data.generateTimeSummary(timeSummaryUnit::hour);}));
+  data.generateTimeSummaryBetween(timeSummaryUnit::hour, 0, 1); // Builds the range index
+  results.record(backend, size, counts, "generateTimeSummaryBetween_30d", timeRuns(reps, [&](){data.generateTimeSummaryBetween(timeSummaryUnit::hour, last - 30 * timeFactors::day, last);}));
+
+  removeFiles(backend);
+}
+
+volatile size_t benchSink; /**< \brief Results of work which would otherwise be optimised out */
+
+/**
+ * @brief Column sums split across 1, 2, 4 and 8 threads, and the core count if more, over a history long enough to split
+ *
+ * Threads are started on each call, so this times their start-up along with the sums. On fewer cores than threads it shows only that overhead
+ */
+void runParallelSum(resultWriter & results, int reps){
+  benchBackend none{"stampColumns", dataBackendType::memory, ""};
+  syntheticHistoryConfig config;
+  config.years = 40;
+  config.switchesPerDay = 200;
+  benchSize size{"40y", config};
+  memoryIO io;
+  syntheticHistory gen;
+  syntheticHistoryCounts counts = gen.generate(config, io);
+  stampColumns columns(io.fetchTrackerEntries());
+
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  auto single = columns.durations();
+  for(size_t threads = 1; threads <= std::max<size_t>(cores, 8); threads *= 2){
+    std::vector<timecode> totals;
+    results.record(none, size, counts, "stampColumns_durations_" + std::to_string(threads) + "t", timeRuns(reps, [&](){totals = columns.durations(-1, -1, nullptr, threads);}));
+    if(totals != single) throw std::runtime_error("Parallel column sum differs from single-threaded at " + std::to_string(threads) + " threads");
+  }
+}
+
+/** \brief Subprojects for a list of parents - 1, 100 and 10k parent ids. Each backend holds 10k projects with two subprojects apiece */
+void runSubprojectFilter(const benchBackend & backend, resultWriter & results, int reps){
+  const size_t projectCount = 10000, subsEach = 2;
+  benchSize size{"10k", syntheticHistoryConfig()};
+  syntheticHistoryCounts counts;
+  counts.projects = projectCount;
+  counts.subprojects = projectCount * subsEach;
+
+  removeFiles(backend);
+  std::unique_ptr<dataIO> io(openBackend(backend));
+  uniqueIdGenerator gen;
+  std::vector<proIds::Uuid> parents;
+  for(size_t i = 0; i < projectCount; i++){
+    proIds::Uuid id = gen.getNextId();
+    io->writeProject(fullProjectData(id, projectData{"Project " + std::to_string(i), 0.0f, 0, 0, false, false}));
+    for(size_t s = 0; s < subsEach; s++){
+      io->writeSubproject(fullSubProjectData(gen.getNextId(proIds::uidTag::sub), subProjectData{"Sub " + std::to_string(s), 0.5f}, id));
+    }
+    parents.push_back(id);
+  }
+  io->flush();
+
+  size_t sink = 0;
+  for(size_t count : {(size_t)1, (size_t)100, projectCount}){
+    std::vector<proIds::Uuid> ids(parents.begin(), parents.begin() + count);
+    std::string stage = "fetchSubprojectListForParents_" + (count == projectCount ? std::string("10k") : std::to_string(count));
+    size_t found = 0;
+    results.record(backend, size, counts, stage, timeRuns(reps, [&](){found = io->fetchSubprojectListForParents(ids).size();}));
+    if(found != count * subsEach) throw std::runtime_error("Wrong subproject count for " + std::to_string(count) + " parents");
+    sink += found;
+  }
+  benchSink = sink;
+  io.reset();
+  removeFiles(backend);
+}
+
+/** \brief Time formatting and parsing, fast paths against the libc ones they replaced. Not backend dependent */
+void runTimeFormatting(resultWriter & results, int reps){
+  const size_t count = 100000;
+  benchBackend none{"timeWrapper", dataBackendType::memory, ""};
+  benchSize size{"100k", syntheticHistoryConfig()};
+  syntheticHistoryCounts counts;
+  counts.stamps = count;
+
+  std::vector<long long> times;
+  for(size_t i = 0; i < count; i++) times.push_back(1420416000 + (long long)i * 6317); // ~20 years, hitting every hour
+  std::vector<std::string> strings;
+  for(auto t : times) strings.push_back(timeWrapper::formatTime(timeWrapper::fromSeconds(t)));
+
+  size_t sink = 0; // Keep the work from being optimised out
+  results.record(none, size, counts, "formatTime_libc", timeRuns(reps, [&](){
+    for(auto t : times){
+      std::time_t time = t;
+      char buffer[100];
+      std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", std::localtime(&time));
+      sink += std::string(buffer).size();
+    }
+  }));
+  results.record(none, size, counts, "formatTime", timeRuns(reps, [&](){
+    for(auto t : times) sink += timeWrapper::formatTime(timeWrapper::fromSeconds(t)).size();
+  }));
+  results.record(none, size, counts, "formatSecondsTo", timeRuns(reps, [&](){
+    char buffer[timeWrapper::formattedLength];
+    for(auto t : times){
+      timeWrapper::formatSecondsTo(t, buffer);
+      sink += buffer[18];
+    }
+  }));
+  results.record(none, size, counts, "parseTimeZoned_libc", timeRuns(reps, [&](){
+    for(auto & str : strings){
+      std::tm tm = {};
+      std::istringstream ss(str);
+      ss >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
+      tm.tm_isdst = -1;
+      sink += std::mktime(&tm);
+    }
+  }));
+  results.record(none, size, counts, "parseTimeZoned", timeRuns(reps, [&](){
+    for(auto & str : strings) sink += timeWrapper::toSeconds(timeWrapper::parseTimeZoned(str));
+  }));
+  benchSink = sink;
+}
+
+/** \brief Project lookup and iteration with many projects, slot map store against the Uuid-keyed maps it replaced. Not backend dependent */
+void runProjectStore(resultWriter & results, int reps){
+  const size_t projectCount = 5000, subsEach = 4;
+  benchBackend none{"projectManager", dataBackendType::memory, ""};
+  benchSize size{"5k", syntheticHistoryConfig()};
+  syntheticHistoryCounts counts;
+  counts.projects = projectCount;
+  counts.subprojects = projectCount * subsEach;
+
+  projectManager pm;
+  std::map<proIds::Uuid, project> mapProjects; // As the manager held them before
+  std::map<proIds::Uuid, subproject> mapSubs;
+  std::map<proIds::Uuid, std::vector<proIds::Uuid>> mapChildren;
+  std::vector<proIds::Uuid> projectIds, allIds;
+  for(size_t i = 0; i < projectCount; i++){
+    projectData dat{"Project " + std::to_string((i * 7919) % projectCount), 0.0f, 0, 0, false, false}; // Not in creation order
+    auto id = pm.addProject(dat, 0);
+    mapProjects[id] = project(fullProjectData(id, dat));
+    projectIds.push_back(id);
+    allIds.push_back(id);
+    for(size_t s = 0; s < subsEach; s++){
+      subProjectData sub{"Sub " + std::to_string(subsEach - s), 0.2f};
+      auto subId = pm.addSubproject(sub, id);
+      mapSubs[subId] = subproject(fullSubProjectData(subId, sub, id));
+      mapChildren[id].push_back(subId);
+      allIds.push_back(subId);
+    }
+  }
+  if(!pm.checkAggregates()) throw std::runtime_error("Project allocation totals out of step after bulk add");
+
+  size_t sink = 0;
+  results.record(none, size, counts, "lookup_map", timeRuns(reps, [&](){
+    for(auto & id : allIds){
+      auto proj = mapProjects.find(id);
+      if(proj != mapProjects.end()){
+        sink += proj->second.getName().size();
+      }else{
+        sink += mapSubs[id].getName().size();
+      }
+    }
+  }));
+  results.record(none, size, counts, "lookup", timeRuns(reps, [&](){
+    for(auto & id : allIds) sink += pm.getName(id).size();
+  }));
+  results.record(none, size, counts, "availableSubFrac_map", timeRuns(reps, [&](){
+    for(auto & id : projectIds){
+      float total = 0.0;
+      for(auto & sub : mapChildren[id]) total += mapSubs[sub].getFrac();
+      sink += total > 0.5;
+    }
+  }));
+  results.record(none, size, counts, "availableSubFrac", timeRuns(reps, [&](){
+    for(auto & id : projectIds) sink += pm.availableSubFrac(id) < 0.5;
+  }));
+  results.record(none, size, counts, "getDetailsForAll", timeRuns(reps, [&](){sink += pm.getDetailsForAll().size();}));
+  results.record(none, size, counts, "orderedRefs_map", timeRuns(reps, [&](){
+    std::vector<project *> refs;
+    for(auto & it : mapProjects) refs.push_back(&it.second);
+    std::sort(refs.begin(), refs.end(), [](project * a, project * b){return a->getName() < b->getName();});
+    for(auto proj : refs){
+      std::vector<subproject *> subs;
+      for(auto & sub : mapChildren[proj->getUid()]) subs.push_back(&mapSubs[sub]);
+      std::sort(subs.begin(), subs.end(), [](subproject * a, subproject * b){return a->getName() < b->getName();});
+      sink += subs.size();
+    }
+  }));
+  results.record(none, size, counts, "orderedRefs", timeRuns(reps, [&](){
+    for(auto proj : pm.getOrderedProjectRefs()) sink += pm.getOrderedSubRefs(*proj).size();
+  }));
+  results.record(none, size, counts, "getOrderedProjectList", timeRuns(reps, [&](){sink += pm.getOrderedProjectList().size();}));
+  benchSink = sink;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    qputenv("QT_QPA_PLATFORM", "offscreen"); // TrackerData is a QWidget, but nothing is shown
+    QApplication app(argc, argv);
+
+    std::string outName = "bench_output.txt";
+    bool quick = false;
+    for(int i = 1; i < argc; i++){
+      std::string arg = argv[i];
+      if(arg == "--quick"){
+        quick = true;
+      }else{
+        outName = arg;
+      }
+    }
+
+    std::vector<benchSize> sizes;
+    syntheticHistoryConfig small, medium, large;
+    small.years = 1;
+    medium.years = 5;
+    medium.projects = 20;
+    medium.switchesPerDay = 16;
+    large.years = 20;
+    large.projects = 40;
+    large.switchesPerDay = 32;
+    sizes.push_back({"small", small});
+    if(!quick){
+      sizes.push_back({"medium", medium});
+      sizes.push_back({"large", large});
+    }
+    std::vector<benchBackend> backends = {
+      {"memory", dataBackendType::memory, ""},
+      {"flatfile", dataBackendType::flatfile, "bench_data"},
+      {"database", dataBackendType::database, "bench_data.db"},
+    };
+
+    resultWriter results(outName);
+    auto * coutBuf = std::cout.rdbuf(nullptr); // The stores and TrackerData log freely - keep it out of the timings
+    try{
+      for(auto & backend : backends) checkSameSecondOrder(backend);
+      for(auto & size : sizes){
+        for(auto & backend : backends){
+          runOne(backend, size, results, quick ? 3 : 5);
+        }
+      }
+      for(auto & backend : backends){
+        runSubprojectFilter(backend, results, quick ? 3 : 5);
+      }
+      runParallelSum(results, quick ? 3 : 5);
+      runTimeFormatting(results, quick ? 3 : 5);
+      runProjectStore(results, quick ? 3 : 5);
+    }catch(const std::runtime_error &e){
+      std::cerr << "Benchmark failed: " << e.what() << std::endl;
+      return 1;
+    }
+    std::cout.rdbuf(coutBuf);
+    std::cout.clear(); // Writes with no buffer set badbit
+    std::cout << "Results written to " << outName << std::endl;
+    return 0;
+}
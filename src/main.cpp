@@ -28,6 +28,10 @@ int main(int argc, char *argv[]) {
     appConfig config;
     config.dataFileName = "data.db"; // Default data file name
     config.backend = dataBackendType::database; // Default backend type
+    config.asyncWrites = true; // Keep disk waits off the GUI thread
+    for(int i = 1; i < argc; i++){
+      if(std::string(argv[i]) == "--rebuild-digests") config.rebuildDigests = true; // Recover digests for a database edited by hand
+    }
     Controller cc(config);
     return app.exec();
 }